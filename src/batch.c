@@ -0,0 +1,345 @@
+#include "batch.h"
+#include "libsim.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ARGS 256
+
+enum job_status { JOB_OK, JOB_FAULT, JOB_TIMEOUT, JOB_LOAD_ERROR, JOB_INPUT_ERROR, JOB_OUT_OF_MEMORY };
+
+static const char* status_names[] = { "ok", "fault", "timeout", "load-error", "input-error", "out-of-memory" };
+
+struct job {
+    // from the manifest
+    char* elf;
+    char* args;
+    char* input;            // NULL for none
+    char* expected;         // NULL for none
+    long max_insns;         // negative for no limit
+    // results
+    int status;
+    struct Stat stats;
+    double host_seconds;    // CPU time of the worker thread
+    int output_matches;     // -1 if there was no expected output
+};
+
+// A worker's jobs. The owner takes from the bottom, thieves from the top.
+struct job_queue {
+    pthread_mutex_t lock;
+    int* jobs;
+    int top;
+    int bottom;
+};
+
+struct batch {
+    struct job* jobs;
+    int num_jobs;
+    struct job_queue* queues;
+    int num_queues;
+};
+
+struct worker {
+    struct batch* batch;
+    int index;
+};
+
+// "-" and empty fields mean none
+static char* field_or_null(char* field)
+{
+    return field && *field && strcmp(field, "-") ? field : NULL;
+}
+
+static char* read_file(const char* name, size_t* len)
+{
+    FILE* file = fopen(name, "rb");
+    if (!file) return NULL;
+    size_t cap = 1 << 12;
+    char* data = malloc(cap);
+    *len = 0;
+    while (data) {
+        *len += fread(data + *len, 1, cap - *len, file);
+        if (*len < cap) break;
+        cap *= 2;
+        char* grown = realloc(data, cap);
+        if (!grown) free(data);
+        data = grown;
+    }
+    fclose(file);
+    return data;
+}
+
+static void free_jobs(struct batch* batch)
+{
+    for (int i = 0; i < batch->num_jobs; i++)
+        free(batch->jobs[i].elf);
+    free(batch->jobs);
+    batch->jobs = NULL;
+    batch->num_jobs = 0;
+}
+
+// all or nothing: on an error no jobs are left
+static int parse_manifest(const char* manifest, long max_insns, struct batch* batch)
+{
+    FILE* file = fopen(manifest, "r");
+    if (!file) {
+        perror(manifest);
+        return -1;
+    }
+    int cap = 0;
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int error = 0;
+    while ((len = getline(&line, &line_cap, file)) >= 0) {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = 0;
+        if (len == 0 || line[0] == '#') continue;
+        if (batch->num_jobs == cap) {
+            cap = cap ? 2 * cap : 64;
+            struct job* grown = realloc(batch->jobs, cap * sizeof(struct job));
+            if (!grown) {
+                error = 1;
+                break;
+            }
+            batch->jobs = grown;
+        }
+        char* rest = strdup(line);
+        if (!rest) {
+            error = 1;
+            break;
+        }
+        struct job* job = &batch->jobs[batch->num_jobs++];
+        memset(job, 0, sizeof(*job));
+        char* fields[5] = { NULL, NULL, NULL, NULL, NULL };
+        for (int i = 0; i < 5 && rest; i++)
+            fields[i] = strsep(&rest, "\t");
+        job->elf = fields[0];   // owns the line copy
+        job->args = field_or_null(fields[1]);
+        job->input = field_or_null(fields[2]);
+        job->expected = field_or_null(fields[3]);
+        job->max_insns = field_or_null(fields[4]) ? strtol(fields[4], NULL, 0) : max_insns;
+    }
+    // getline also fails when it cannot grow the line
+    if (!error && !feof(file))
+        error = 1;
+    free(line);
+    fclose(file);
+    if (error) {
+        fprintf(stderr, "%s: out of memory reading the manifest\n", manifest);
+        free_jobs(batch);
+        return -1;
+    }
+    return 0;
+}
+
+// split args into argv, with '--' first; returns argc. argv points into 'copy'
+static int split_args(char* copy, char* argv[])
+{
+    static char separator[] = "--";
+    int argc = 0;
+    char* save;
+    for (char* token = strtok_r(copy, " ", &save); token && argc < MAX_ARGS; token = strtok_r(NULL, " ", &save)) {
+        if (argc == 0 && strcmp(token, "--"))
+            argv[argc++] = separator;
+        argv[argc++] = token;
+    }
+    return argc;
+}
+
+static double thread_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run_job(struct job* job)
+{
+    job->output_matches = -1;
+    int input_fd = open(job->input ? job->input : "/dev/null", O_RDONLY);
+    if (input_fd < 0) {
+        job->status = JOB_INPUT_ERROR;
+        return;
+    }
+    struct sim_options options;
+    sim_default_options(&options);
+    options.in_fd = input_fd;
+    options.out_fd = -1;
+    options.console_mode = CONSOLE_FULL;
+    struct sim* sim = sim_create(&options);
+    char* argv[MAX_ARGS + 1];
+    char* copy = job->args ? strdup(job->args) : NULL;
+    job->status = JOB_OUT_OF_MEMORY;
+    if (!sim || (job->args && !copy))
+        goto done;
+    int result = sim_load(sim, job->elf, copy ? split_args(copy, argv) : 0, argv);
+    if (result != SIM_OK) {
+        job->status = result == SIM_ERR_NO_MEMORY ? JOB_OUT_OF_MEMORY : JOB_LOAD_ERROR;
+        goto done;
+    }
+
+    double start = thread_seconds();
+    result = sim_run(sim, job->max_insns);
+    job->host_seconds = thread_seconds() - start;
+    job->stats = *sim_stats(sim);
+    job->status = result == SIM_STOPPED ? JOB_TIMEOUT : job->stats.fault ? JOB_FAULT : JOB_OK;
+
+    if (job->expected) {
+        size_t expected_len, output_len;
+        char* expected = read_file(job->expected, &expected_len);
+        const char* output = sim_output(sim, &output_len);
+        job->output_matches = expected && expected_len == output_len && !memcmp(expected, output, output_len);
+        free(expected);
+    }
+done:
+    sim_destroy(sim);
+    free(copy);
+    close(input_fd);
+}
+
+// the next job for worker 'self': its own newest job, or else the oldest job
+// of another worker. -1 when all queues are empty (no new jobs ever arrive).
+static int next_job(struct batch* batch, int self)
+{
+    struct job_queue* own = &batch->queues[self];
+    int job = -1;
+    pthread_mutex_lock(&own->lock);
+    if (own->bottom > own->top)
+        job = own->jobs[--own->bottom];
+    pthread_mutex_unlock(&own->lock);
+    for (int i = 1; job < 0 && i < batch->num_queues; i++) {
+        struct job_queue* victim = &batch->queues[(self + i) % batch->num_queues];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->bottom > victim->top)
+            job = victim->jobs[victim->top++];
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return job;
+}
+
+static void* worker_main(void* arg)
+{
+    struct worker* worker = arg;
+    int job;
+    while ((job = next_job(worker->batch, worker->index)) >= 0)
+        run_job(&worker->batch->jobs[job]);
+    return NULL;
+}
+
+static void print_json_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        if ((unsigned char)*s < 0x20) fprintf(out, "\\u%04x", *s);
+        else fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// quoted, as a path may hold commas, quotes or line breaks
+static void print_csv_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"') fputc('"', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void print_results(struct batch* batch, int json, FILE* out)
+{
+    if (json) fprintf(out, "[\n");
+    else fprintf(out, "job,elf,status,exit,insns,host_ms,mips,output\n");
+    for (int i = 0; i < batch->num_jobs; i++) {
+        struct job* job = &batch->jobs[i];
+        double mips = job->host_seconds > 0 ? job->stats.insns / job->host_seconds / 1e6 : 0;
+        const char* output = job->output_matches < 0 ? "-" : job->output_matches ? "match" : "mismatch";
+        if (json) {
+            fprintf(out, "  {\"job\": %d, \"elf\": ", i);
+            print_json_string(out, job->elf);
+            fprintf(out, ", \"status\": \"%s\", \"exit\": %d, \"insns\": %ld, \"host_ms\": %.3f, \"mips\": %.2f, \"output\": \"%s\"}%s\n",
+                    status_names[job->status], job->stats.exit_code, job->stats.insns,
+                    job->host_seconds * 1e3, mips, output, i + 1 < batch->num_jobs ? "," : "");
+        } else {
+            fprintf(out, "%d,", i);
+            print_csv_string(out, job->elf);
+            fprintf(out, ",%s,%d,%ld,%.3f,%.2f,%s\n", status_names[job->status],
+                    job->stats.exit_code, job->stats.insns, job->host_seconds * 1e3, mips, output);
+        }
+    }
+    if (json) fprintf(out, "]\n");
+}
+
+int batch_run(const char* manifest, int num_threads, long max_insns, int json, FILE* out)
+{
+    struct batch batch = { NULL, 0, NULL, 0 };
+    if (parse_manifest(manifest, max_insns, &batch))
+        return -1;
+    if (num_threads <= 0)
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > batch.num_jobs)
+        num_threads = batch.num_jobs;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    // deal the jobs out round robin
+    batch.num_queues = num_threads;
+    batch.queues = calloc(num_threads, sizeof(struct job_queue));
+    struct worker* workers = calloc(num_threads, sizeof(struct worker));
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    int ok = batch.queues && workers && threads;
+    for (int q = 0; ok && q < num_threads; q++) {
+        batch.queues[q].jobs = malloc((batch.num_jobs / num_threads + 1) * sizeof(int));
+        ok = batch.queues[q].jobs != NULL;
+    }
+    if (!ok) {
+        fprintf(stderr, "Out of memory\n");
+        for (int q = 0; batch.queues && q < num_threads; q++)
+            free(batch.queues[q].jobs);
+        free_jobs(&batch);
+        free(batch.queues);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+    for (int q = 0; q < num_threads; q++)
+        pthread_mutex_init(&batch.queues[q].lock, NULL);
+    for (int i = 0; i < batch.num_jobs; i++) {
+        struct job_queue* queue = &batch.queues[i % num_threads];
+        queue->jobs[queue->bottom++] = i;
+    }
+
+    // the queues of workers that could not be started are left to the others
+    // to steal from, so in the worst case this thread runs every job
+    int started = 0;
+    for (int t = 1; t < num_threads; t++) {
+        workers[t] = (struct worker){ &batch, t };
+        if (pthread_create(&threads[started], NULL, worker_main, &workers[t]) == 0)
+            started++;
+    }
+    workers[0] = (struct worker){ &batch, 0 };
+    worker_main(&workers[0]);
+    for (int t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+
+    print_results(&batch, json, out);
+    int failed = 0;
+    for (int i = 0; i < batch.num_jobs; i++) {
+        struct job* job = &batch.jobs[i];
+        failed += job->status != JOB_OK || job->output_matches == 0;
+    }
+    free_jobs(&batch);
+    for (int q = 0; q < num_threads; q++) {
+        pthread_mutex_destroy(&batch.queues[q].lock);
+        free(batch.queues[q].jobs);
+    }
+    free(batch.queues);
+    free(workers);
+    free(threads);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+
+// Batch runner: runs the jobs listed in a manifest on a pool of worker
+// threads. Each job gets its own memory, predecoded text, console and system
+// call table, so jobs share nothing. Every worker has a queue of jobs; a
+// worker that runs out steals from the others, so a few long jobs do not
+// leave the other threads idle.
+//
+// The manifest has one job per line, with tab separated fields
+//
+//   riscv-elf <TAB> prog-args <TAB> stdin-file <TAB> expected-output-file <TAB> max-insns
+//
+// Only the first field is required; '-' or an empty field means none. The
+// program arguments are given as after '--' on the command line. Lines
+// starting with '#' are comments.
+//
+// A job stops after max-insns instructions, or 'max_insns' if its line has
+// none (no limit if that is negative), and then has the status 'timeout', so
+// a program that never exits does not hold a worker forever.
+//
+// Writes one line (CSV, with the elf path quoted) or object (JSON) per job to
+// 'out', in manifest order, with instructions, host CPU time, MIPS and whether
+// the output matched.
+// Returns 0 if every job ran to exit and matched its expected output, -1 if
+// the manifest could not be read.
+#define BATCH_MAX_INSNS 10000000000L
+int batch_run(const char* manifest, int num_threads, long max_insns, int json, FILE* out);
+
+#endif
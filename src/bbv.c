@@ -0,0 +1,75 @@
+#include "bbv.h"
+#include <stdlib.h>
+
+struct bbv* bbv_create(const struct predecode* pd, long interval, FILE* out)
+{
+    struct bbv* bbv = calloc(1, sizeof(struct bbv));
+    if (!bbv)
+        return NULL;
+    bbv->out = out;
+    bbv->interval = interval > 0 ? interval : 1;
+    bbv->count = pd->count;
+    bbv->id = calloc(pd->count + 1, sizeof(uint32_t));
+    bbv->weight = calloc(pd->count + 1, sizeof(uint64_t));
+    bbv->used = calloc(pd->count + 1, sizeof(uint32_t));
+    if (!bbv->id || !bbv->weight || !bbv->used) {
+        free(bbv->id);
+        free(bbv->weight);
+        free(bbv->used);
+        free(bbv);
+        return NULL;
+    }
+    for (int id = 1; id < NUM_INSNS; id++) {
+        switch (insn_info[id].format) {
+        case FMT_B:
+        case FMT_J:
+        case FMT_SYS:
+            bbv->ends_block[id] = 1;
+            break;
+        default:
+            bbv->ends_block[id] = insn_info[id].base == INSN_JALR;
+            break;
+        }
+    }
+    return bbv;
+}
+
+void bbv_delete(struct bbv* bbv)
+{
+    if (!bbv)
+        return;
+    bbv_flush(bbv);
+    free(bbv->id);
+    free(bbv->weight);
+    free(bbv->used);
+    free(bbv);
+}
+
+void bbv_flush(struct bbv* bbv)
+{
+    if (bbv->in_interval == 0)
+        return;
+    fputc('T', bbv->out);
+    for (uint32_t i = 0; i < bbv->num_used; i++) {
+        uint32_t start = bbv->used[i];
+        fprintf(bbv->out, ":%u:%llu ", bbv->id[start], (unsigned long long)bbv->weight[start]);
+        bbv->weight[start] = 0;
+    }
+    fputc('\n', bbv->out);
+    bbv->num_used = 0;
+    bbv->in_interval = 0;
+}
+
+void bbv_block(struct bbv* bbv, int64_t start, uint32_t length)
+{
+    if (start >= 0 && (uint64_t)start < bbv->count) {
+        if (!bbv->id[start])
+            bbv->id[start] = ++bbv->next_id;
+        if (!bbv->weight[start])
+            bbv->used[bbv->num_used++] = start;
+        bbv->weight[start] += length;
+    }
+    bbv->in_interval += length;
+    if (bbv->in_interval >= bbv->interval)
+        bbv_flush(bbv);
+}
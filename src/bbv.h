@@ -0,0 +1,43 @@
+#ifndef __BBV_H__
+#define __BBV_H__
+
+#include "predecode.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Basic block vectors for SimPoint. The run is cut into intervals of a fixed
+// number of instructions; for each interval one line in the SimPoint .bb
+// format gives, per basic block that ran, the number of instructions run in it
+// (executions times block size):
+//
+//   T:1:2048 :2:512 :7:96
+//
+// Blocks are numbered from 1 in the order they first run. A block starts
+// after a branch, jump or ecall and ends with the next one. Only code in the text segment is counted, but all instructions
+// count towards the interval. The interval ends with the first block that
+// reaches it, so it can be a little longer.
+
+struct bbv {
+    FILE* out;
+    long interval;
+    long in_interval;           // instructions so far in this interval
+    uint32_t count;             // instructions in the text segment
+    uint32_t next_id;
+    uint32_t* id;               // block number per start instruction, 0 for none yet
+    uint64_t* weight;           // instructions per start instruction in this interval
+    uint32_t* used;             // start instructions with a weight
+    uint32_t num_used;
+    uint8_t ends_block[256];    // per insn_id
+};
+
+// for the text segment of pd, writing to 'out'; NULL if out of memory
+struct bbv* bbv_create(const struct predecode* pd, long interval, FILE* out);
+
+// writes the interval so far, if any
+void bbv_delete(struct bbv* bbv);
+void bbv_flush(struct bbv* bbv);
+
+// a block starting at text index 'start' (-1 outside the text segment) ran 'length' instructions
+void bbv_block(struct bbv* bbv, int64_t start, uint32_t length);
+
+#endif
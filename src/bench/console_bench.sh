@@ -0,0 +1,23 @@
+#!/bin/sh
+# Characters per second through the guest console, one putchar system call
+# per character versus one write system call per line.
+#
+#   bench/console_bench.sh [sim]      (run from src/, as 'make console-bench' does)
+
+SIM=${1:-./sim}
+DIR=$(dirname "$0")
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+
+for prog in console_putchar console_write; do
+    # no -s: the summary would time every system call
+    start=$(date +%s.%N)
+    "$SIM" "$DIR/$prog.riscv" > "$OUT"
+    end=$(date +%s.%N)
+    # the output ends with an empty line and the "Simulated ..." line
+    chars=$(( $(wc -c < "$OUT") - $(tail -n 2 "$OUT" | wc -c) ))
+    echo "$prog $chars $start $end" | awk '{
+        secs = $4 - $3
+        printf "%-16s %9d chars in %7.3f s  %12.0f chars/s\n", $1, $2, secs, $2 / secs
+    }'
+done
@@ -0,0 +1,30 @@
+# Console benchmark, putchar path: prints LINES lines of 64 characters
+# with one putchar system call (a7 = 2) per character.
+#
+# Built with
+#   make bench/console_putchar.riscv      (tools/rvasm bench/console_putchar.s -o bench/console_putchar.riscv)
+
+        .equ LINES, 65536
+
+        .text
+        .globl _start
+_start:
+        li      s0, LINES
+        la      s2, line_end
+next_line:
+        la      s1, line
+next_char:
+        lbu     a0, 0(s1)
+        li      a7, 2
+        ecall
+        addi    s1, s1, 1
+        bne     s1, s2, next_char
+        addi    s0, s0, -1
+        bnez    s0, next_line
+        li      a0, 0
+        li      a7, 93
+        ecall
+
+        .data
+line:   .ascii  "The quick brown fox jumps over the lazy dog 0123456789 abcdefgh\n"
+line_end:
@@ -0,0 +1,26 @@
+# Console benchmark, write path: prints LINES lines of 64 characters
+# with one write system call (a7 = 64) per line.
+#
+# Built with
+#   make bench/console_write.riscv      (tools/rvasm bench/console_write.s -o bench/console_write.riscv)
+
+        .equ LINES, 65536
+
+        .text
+        .globl _start
+_start:
+        li      s0, LINES
+next_line:
+        li      a0, 1
+        la      a1, line
+        li      a2, 64
+        li      a7, 64
+        ecall
+        addi    s0, s0, -1
+        bnez    s0, next_line
+        li      a0, 0
+        li      a7, 93
+        ecall
+
+        .data
+line:   .ascii  "The quick brown fox jumps over the lazy dog 0123456789 abcdefgh\n"
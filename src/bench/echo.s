@@ -0,0 +1,33 @@
+# Guest benchmark: system calls. Copies stdin to stdout in CHUNK byte
+# reads and writes until end of input.
+# Exits with 0.
+#
+# Built with
+#   make bench/echo.riscv      (tools/rvasm bench/echo.s -o bench/echo.riscv)
+
+        .equ CHUNK, 64
+
+        .text
+        .globl _start
+_start:
+        la      s0, buffer
+next:
+        li      a0, 0
+        mv      a1, s0
+        li      a2, CHUNK
+        li      a7, 63
+        ecall
+        blez    a0, done
+        mv      a2, a0
+        li      a0, 1
+        mv      a1, s0
+        li      a7, 64
+        ecall
+        j       next
+done:
+        li      a0, 0
+        li      a7, 93
+        ecall
+
+        .bss
+buffer: .zero   CHUNK
@@ -0,0 +1,42 @@
+# Guest benchmark: recursive fib(N), calls and returns through the stack.
+# Exits with fib(N) & 0xff (fib(28) = 317811, exit code 115).
+#
+# Built with
+#   make bench/fib.riscv      (tools/rvasm bench/fib.s -o bench/fib.riscv)
+
+        .equ N, 28
+
+        .text
+        .globl _start
+_start:
+        li      sp, 0x1000000
+        li      a0, N
+        call    fib
+        andi    a0, a0, 0xff
+        li      a7, 93
+        ecall
+
+# a0 = fib(a0)
+fib:
+        li      t0, 2
+        blt     a0, t0, fib_done
+        addi    sp, sp, -16
+        sw      ra, 12(sp)
+        sw      s0, 8(sp)
+        sw      s1, 4(sp)
+        mv      s0, a0
+        addi    a0, a0, -1
+        call    fib
+        mv      s1, a0
+        addi    a0, s0, -2
+        call    fib
+        add     a0, a0, s1
+        lw      ra, 12(sp)
+        lw      s0, 8(sp)
+        lw      s1, 4(sp)
+        addi    sp, sp, 16
+fib_done:
+        ret
+
+        .data
+        .word   N
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Guest benchmark suite: runs each workload RUNS times and reports the
+# median and 95th percentile host time and the MIPS they give, as a table
+# and as JSON for tracking regressions between releases.
+#
+#   bench/guest_bench.sh [sim] [runs] [json file]   (run from src/, as 'make bench' does)
+#
+# Host time is wall time around the whole sim process, so it includes
+# loading the ELF. The p95 MIPS is the MIPS of the p95 (slow) run.
+#
+# Every run must give the workload's known exit code and output, or the
+# suite stops with an error instead of timing a broken simulator.
+
+SIM=${1:-./sim}
+RUNS=${2:-5}
+JSON=${3:-bench/guest_bench.json}
+DIR=$(dirname "$0")
+OUT=$(mktemp)
+TIMES=$(mktemp)
+INPUT=$(mktemp)
+GUEST_OUT=$(mktemp)
+trap 'rm -f "$OUT" "$TIMES" "$INPUT" "$GUEST_OUT"' EXIT
+
+# 4 MiB of text for the echo workload
+yes "The quick brown fox jumps over the lazy dog 0123456789 abcdefghij" | head -c 4194304 > "$INPUT"
+
+# workload name, stdin, expected output, expected exit code
+WORKLOADS="fib:/dev/null:/dev/null:115 sieve:/dev/null:/dev/null:197 memcpy:/dev/null:/dev/null:0
+           sort:/dev/null:/dev/null:0 muldiv:/dev/null:/dev/null:145 echo:$INPUT:$INPUT:0"
+
+printf '{\n  "sim": "%s",\n  "runs": %d,\n  "host": "%s",\n  "date": "%s",\n  "workloads": [' \
+    "$SIM" "$RUNS" "$(uname -m)" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" > "$JSON"
+printf '%-8s %12s %10s %10s %9s %9s\n' workload insns "median s" "p95 s" "med MIPS" "p95 MIPS"
+separator=""
+for workload in $WORKLOADS; do
+    IFS=:
+    set -- $workload
+    unset IFS
+    name=$1 input=$2 expected=$3 code=$4
+    : > "$TIMES"
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        "$SIM" "$DIR/$name.riscv" < "$input" > "$OUT"
+        status=$?
+        end=$(date +%s.%N)
+        # the program's output is what comes before "\nSimulated <n> instructions ...\n"
+        size=$(wc -c < "$OUT")
+        trailer=$(tail -n 1 "$OUT" | wc -c)
+        head -c $((size - trailer - 1)) "$OUT" > "$GUEST_OUT"
+        if [ $status -ne "$code" ] || ! cmp -s "$GUEST_OUT" "$expected"; then
+            echo "$name: exit code $status (expected $code) or wrong output, not a valid benchmark" >&2
+            exit 1
+        fi
+        echo "$start $end" | awk '{ printf "%.6f\n", $2 - $1 }' >> "$TIMES"
+        run=$((run + 1))
+    done
+    # the last line of the output is "Simulated <n> instructions in ..."
+    insns=$(tail -n 1 "$OUT" | awk '{ print $2 }')
+    sort -n "$TIMES" | awk -v name="$name" -v insns="$insns" -v json="$JSON" -v sep="$separator" '
+        { t[NR] = $1 }
+        END {
+            median = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+            p95 = t[int(0.95 * NR + 0.999999)]
+            printf "%-8s %12d %10.4f %10.4f %9.1f %9.1f\n", name, insns, median, p95,
+                   insns / median / 1e6, insns / p95 / 1e6
+            printf "%s\n    { \"name\": \"%s\", \"insns\": %d, \"host_s_median\": %.6f, \"host_s_p95\": %.6f, \"mips_median\": %.2f, \"mips_p95\": %.2f }",
+                   sep, name, insns, median, p95, insns / median / 1e6, insns / p95 / 1e6 >> json
+        }'
+    separator=","
+done
+printf '\n  ]\n}\n' >> "$JSON"
+echo "results in $JSON"
@@ -0,0 +1,83 @@
+# Guest benchmark: copies a 64 KiB block back and forth ROUNDS times with an
+# unrolled word loop, then checksums it. Loads and stores, few branches.
+# Exits with the checksum & 0xff (exit code 0 when the copies are right).
+#
+# Built with
+#   make bench/memcpy.riscv      (tools/rvasm bench/memcpy.s -o bench/memcpy.riscv)
+
+        .equ BYTES, 65536
+        .equ ROUNDS, 200
+
+        .text
+        .globl _start
+_start:
+        li      sp, 0x1000000
+        # fill the source with 0, 1, 2, ...
+        la      s0, block_a
+        la      s1, block_b
+        li      t0, 0
+        li      t1, BYTES / 4
+fill:
+        slli    t2, t0, 2
+        add     t2, t2, s0
+        sw      t0, 0(t2)
+        addi    t0, t0, 1
+        blt     t0, t1, fill
+
+        li      s2, ROUNDS
+copy_round:
+        mv      a0, s1
+        mv      a1, s0
+        call    copy
+        mv      a0, s0
+        mv      a1, s1
+        call    copy
+        addi    s2, s2, -1
+        bnez    s2, copy_round
+
+        # sum of 0 .. BYTES/4-1 is 0x7ffe000; subtract it so a good run exits 0
+        li      t0, 0
+        li      a0, 0
+sum:
+        slli    t2, t0, 2
+        add     t2, t2, s0
+        lw      t3, 0(t2)
+        add     a0, a0, t3
+        addi    t0, t0, 1
+        blt     t0, t1, sum
+        li      t3, 0x7ffe000
+        sub     a0, a0, t3
+        andi    a0, a0, 0xff
+        li      a7, 93
+        ecall
+
+# copy BYTES bytes from a1 to a0, 32 bytes per iteration
+copy:
+        li      t6, BYTES
+        add     t6, t6, a1
+copy_loop:
+        lw      t2, 0(a1)
+        lw      t3, 4(a1)
+        lw      t4, 8(a1)
+        lw      t5, 12(a1)
+        sw      t2, 0(a0)
+        sw      t3, 4(a0)
+        sw      t4, 8(a0)
+        sw      t5, 12(a0)
+        lw      t2, 16(a1)
+        lw      t3, 20(a1)
+        lw      t4, 24(a1)
+        lw      t5, 28(a1)
+        sw      t2, 16(a0)
+        sw      t3, 20(a0)
+        sw      t4, 24(a0)
+        sw      t5, 28(a0)
+        addi    a1, a1, 32
+        addi    a0, a0, 32
+        bltu    a1, t6, copy_loop
+        ret
+
+        .bss
+        .p2align 2
+block_a: .zero  BYTES
+block_b: .zero  BYTES
@@ -0,0 +1,40 @@
+# Guest benchmark: the M extension, a chain of mul, mulh, mulhu, div, divu,
+# rem and remu per iteration.
+# Exits with the final value & 0xff, which only checks that the run is
+# deterministic (compare with an earlier run).
+#
+# Built with
+#   make bench/muldiv.riscv      (tools/rvasm bench/muldiv.s -o bench/muldiv.riscv)
+
+        .equ ITERATIONS, 1000000
+
+        .text
+        .globl _start
+_start:
+        la      t0, seed
+        lw      s0, 0(t0)
+        li      s1, ITERATIONS
+        li      s2, 0
+loop:
+        addi    t1, s1, 7
+        mul     t2, s0, t1
+        mulh    t3, s0, t1
+        mulhu   t4, t2, s0
+        xor     t2, t2, t3
+        ori     t5, t1, 1
+        div     t3, t2, t5
+        divu    t4, t4, t5
+        rem     t6, t2, t5
+        remu    a1, s0, t5
+        add     s2, s2, t3
+        add     s2, s2, t4
+        xor     s2, s2, t6
+        add     s0, s2, a1
+        addi    s1, s1, -1
+        bnez    s1, loop
+        andi    a0, s0, 0xff
+        li      a7, 93
+        ecall
+
+        .data
+seed:   .word   0x9e3779b9
@@ -0,0 +1,111 @@
+// Benchmark of the scalar and the AVX2 predecoder
+//
+//   predecode_bench [number of instructions]
+//
+// Fills a synthetic text segment with random RV32IM instructions (and a few
+// invalid words), decodes it with both implementations, checks that they
+// agree and reports the time per instruction.
+
+#include "../predecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEXT_START 0x10000
+#define REPEATS 5
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t random_word(void)
+{
+    uint32_t bits = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    if (rand() % 16 == 0)
+        return bits;
+    const struct insn_info* info = &insn_info[1 + rand() % (NUM_BASE_INSNS - 1)];
+    return (bits & ~info->mask) | info->match;
+}
+
+// best of REPEATS runs, in seconds
+static double time_fill(struct predecode* pd, int avx2)
+{
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        memset(pd->id, 0, pd->count);
+        double start = now();
+        if (avx2) predecode_fill_avx2(pd, 0, pd->count);
+        else predecode_fill_scalar(pd, 0, pd->count);
+        double elapsed = now() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// the decoded fields, for comparing the two implementations
+struct fields {
+    uint8_t* id;
+    uint8_t* rd;
+    uint8_t* rs1;
+    uint8_t* rs2;
+    int32_t* imm;
+};
+
+static void save(struct fields* f, struct predecode* pd)
+{
+    f->id = malloc(pd->count);
+    f->rd = malloc(pd->count);
+    f->rs1 = malloc(pd->count);
+    f->rs2 = malloc(pd->count);
+    f->imm = malloc(pd->count * sizeof(int32_t));
+    memcpy(f->id, pd->id, pd->count);
+    memcpy(f->rd, pd->rd, pd->count);
+    memcpy(f->rs1, pd->rs1, pd->count);
+    memcpy(f->rs2, pd->rs2, pd->count);
+    memcpy(f->imm, pd->imm, pd->count * sizeof(int32_t));
+}
+
+static int same(struct fields* f, struct predecode* pd)
+{
+    return !memcmp(f->id, pd->id, pd->count) && !memcmp(f->rd, pd->rd, pd->count)
+        && !memcmp(f->rs1, pd->rs1, pd->count) && !memcmp(f->rs2, pd->rs2, pd->count)
+        && !memcmp(f->imm, pd->imm, pd->count * sizeof(int32_t));
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t count = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 1u << 22;
+    struct memory* mem = memory_create();
+    for (uint32_t i = 0; i < count; i++)
+        memory_wr_w(mem, TEXT_START + 4 * i, random_word());
+    struct program_info info = { .text_start = TEXT_START, .text_end = TEXT_START + 4 * count,
+                                 .start = TEXT_START, .data_end = TEXT_START + 4 * count };
+    struct predecode* pd = predecode_create(mem, &info);
+    if (!pd) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    struct fields scalar_fields;
+    double scalar = time_fill(pd, 0);
+    save(&scalar_fields, pd);
+    printf("scalar: %8.3f ms  %6.2f ns/insn\n", scalar * 1e3, scalar * 1e9 / count);
+
+    if (!predecode_fill_avx2(pd, 0, 0)) {
+        printf("avx2:   not available on this host\n");
+    } else {
+        double avx2 = time_fill(pd, 1);
+        printf("avx2:   %8.3f ms  %6.2f ns/insn  (%.2fx)\n", avx2 * 1e3, avx2 * 1e9 / count, scalar / avx2);
+        if (!same(&scalar_fields, pd)) {
+            printf("MISMATCH between scalar and avx2 predecoding\n");
+            return 1;
+        }
+    }
+    predecode_delete(pd);
+    memory_delete(mem);
+    return 0;
+}
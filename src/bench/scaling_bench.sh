@@ -0,0 +1,34 @@
+#!/bin/sh
+# Scaling sweeps over synthetic workloads (see tools/rvgen.c): how the
+# simulator's MIPS change as the guest code grows, as its data footprint
+# grows and as its branches become unpredictable. One sweep varies one
+# parameter and keeps the others at rvgen's defaults.
+#
+#   bench/scaling_bench.sh [sim]   (run from src/, as 'make scaling-bench' does)
+#
+# Host time is wall time around the whole sim process.
+
+SIM=${1:-./sim}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# sweep name, rvgen option, values
+run_sweep() {
+    name=$1
+    option=$2
+    shift 2
+    printf '\n%-10s %12s %12s %9s\n' "$name" value insns MIPS
+    for value in "$@"; do
+        ./tools/rvgen "$option" "$value" > "$DIR/w.s" && ./tools/rvasm "$DIR/w.s" -o "$DIR/w.riscv" || exit 1
+        start=$(date +%s.%N)
+        insns=$("$SIM" "$DIR/w.riscv" | tail -n 1 | awk '{ print $2 }')
+        end=$(date +%s.%N)
+        echo "$start $end" | awk -v name="$name" -v value="$value" -v insns="$insns" \
+            '{ printf "%-10s %12s %12d %9.1f\n", name, value, insns, insns / ($2 - $1) / 1e6 }'
+    done
+}
+
+run_sweep blocks -n 16 256 4096 32768
+run_sweep footprint -f 4096 262144 16777216 268435456
+run_sweep predict -p 100 90 50 0
+run_sweep mix -m alu=1 mul=1 div=1 load=1 store=1
@@ -0,0 +1,61 @@
+# Guest benchmark: sieve of Eratosthenes over the bytes of a large array,
+# ROUNDS times. Byte loads and stores, short loops.
+# Exits with the number of primes below SIZE & 0xff (148933 below 2000000,
+# exit code 197).
+#
+# Built with
+#   make bench/sieve.riscv      (tools/rvasm bench/sieve.s -o bench/sieve.riscv)
+
+        .equ SIZE, 2000000
+        .equ ROUNDS, 1
+
+        .text
+        .globl _start
+_start:
+        li      s3, ROUNDS
+round:
+        la      s0, flags
+        li      s1, SIZE
+        # every number is a prime candidate to begin with
+        li      t0, 0
+        li      t1, 1
+clear:
+        add     t2, s0, t0
+        sb      t1, 0(t2)
+        addi    t0, t0, 1
+        blt     t0, s1, clear
+        sb      zero, 0(s0)
+        sb      zero, 1(s0)
+        # strike out the multiples of each prime p with p * p < SIZE
+        li      t0, 2
+outer:
+        mul     t3, t0, t0
+        bge     t3, s1, count
+        add     t2, s0, t0
+        lbu     t4, 0(t2)
+        beqz    t4, next_p
+strike:
+        add     t2, s0, t3
+        sb      zero, 0(t2)
+        add     t3, t3, t0
+        blt     t3, s1, strike
+next_p:
+        addi    t0, t0, 1
+        j       outer
+count:
+        li      a0, 0
+        li      t0, 0
+count_loop:
+        add     t2, s0, t0
+        lbu     t4, 0(t2)
+        add     a0, a0, t4
+        addi    t0, t0, 1
+        blt     t0, s1, count_loop
+        addi    s3, s3, -1
+        bnez    s3, round
+        andi    a0, a0, 0xff
+        li      a7, 93
+        ecall
+
+        .bss
+flags:  .zero   SIZE
@@ -0,0 +1,66 @@
+# Guest benchmark: insertion sort of COUNT pseudo-random words. Mostly
+# data dependent branches that the host cannot predict.
+# Exits with 0 if the array ends up sorted, 1 if not.
+#
+# Built with
+#   make bench/sort.riscv      (tools/rvasm bench/sort.s -o bench/sort.riscv)
+
+        .equ COUNT, 4000
+
+        .text
+        .globl _start
+_start:
+        la      s0, array
+        li      s1, COUNT
+        # linear congruential generator, x = x * 1664525 + 1013904223
+        li      t0, 0
+        li      t1, 12345
+        li      t5, 1664525
+        li      t6, 1013904223
+generate:
+        mul     t1, t1, t5
+        add     t1, t1, t6
+        slli    t2, t0, 2
+        add     t2, t2, s0
+        srli    t3, t1, 1
+        sw      t3, 0(t2)
+        addi    t0, t0, 1
+        blt     t0, s1, generate
+
+        li      t0, 1
+insert:
+        bge     t0, s1, check
+        slli    t2, t0, 2
+        add     t2, t2, s0
+        lw      t3, 0(t2)          # the value to insert
+shift:
+        beq     t2, s0, place
+        lw      t4, -4(t2)
+        ble     t4, t3, place
+        sw      t4, 0(t2)
+        addi    t2, t2, -4
+        j       shift
+place:
+        sw      t3, 0(t2)
+        addi    t0, t0, 1
+        j       insert
+
+check:
+        li      a0, 0
+        li      t0, 1
+check_loop:
+        bge     t0, s1, done
+        slli    t2, t0, 2
+        add     t2, t2, s0
+        lw      t3, -4(t2)
+        lw      t4, 0(t2)
+        addi    t0, t0, 1
+        ble     t3, t4, check_loop
+        li      a0, 1
+done:
+        li      a7, 93
+        ecall
+
+        .bss
+        .p2align 2
+array:  .zero   4 * COUNT
@@ -0,0 +1,84 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NUM_PAGES 0x10000
+
+int checkpoint_write(const char* file_name, struct memory* mem, const struct program_info* info,
+                     const struct hart* hart, const struct guest_heap* heap)
+{
+    uint32_t* page_numbers = malloc(NUM_PAGES * sizeof(uint32_t));
+    if (!page_numbers)
+        return CHECKPOINT_WRITE_ERROR;
+    struct checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.header_size = sizeof(header);
+    for (int i = 0; i < NUM_PAGES; i++)
+        if (memory_page_data(mem, i))
+            page_numbers[header.num_pages++] = i;
+    uint64_t list_end = sizeof(header) + header.num_pages * sizeof(uint32_t);
+    header.data_offset = (list_end + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE * MEMORY_PAGE_SIZE;
+    header.info = *info;
+    header.hart = *hart;
+    header.heap = *heap;
+
+    FILE* file = fopen(file_name, "wb");
+    if (!file) {
+        free(page_numbers);
+        return CHECKPOINT_OPEN_ERROR;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(page_numbers, sizeof(uint32_t), header.num_pages, file) == header.num_pages
+        && fseek(file, header.data_offset, SEEK_SET) == 0;
+    for (uint32_t i = 0; ok && i < header.num_pages; i++)
+        ok = fwrite(memory_page_data(mem, page_numbers[i]), MEMORY_PAGE_SIZE, 1, file) == 1;
+    // an image without pages still needs the file to reach data_offset
+    if (ok && header.num_pages == 0)
+        ok = ftruncate(fileno(file), header.data_offset) == 0;
+    ok = fclose(file) == 0 && ok;
+    free(page_numbers);
+    return ok ? CHECKPOINT_OK : CHECKPOINT_WRITE_ERROR;
+}
+
+int checkpoint_read(const char* file_name, struct memory* mem, struct program_info* info,
+                    struct hart* hart, struct guest_heap* heap)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return CHECKPOINT_OPEN_ERROR;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct checkpoint_header)) {
+        close(fd);
+        return CHECKPOINT_FORMAT_ERROR;
+    }
+    size_t size = st.st_size;
+    // private and writable: the program's stores go to host copies of the pages
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return CHECKPOINT_OPEN_ERROR;
+    const struct checkpoint_header* header = mapping;
+    uint64_t list_end = sizeof(*header) + (uint64_t)header->num_pages * sizeof(uint32_t);
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic))
+        || header->header_size != sizeof(*header) || header->num_pages > NUM_PAGES
+        || header->data_offset % MEMORY_PAGE_SIZE || header->data_offset < list_end
+        || header->heap.num_mappings > HEAP_MAX_MAPPINGS) {
+        munmap(mapping, size);
+        return CHECKPOINT_FORMAT_ERROR;
+    }
+    *info = header->info;
+    *hart = header->hart;
+    *heap = header->heap;
+    const unsigned* page_numbers = (const unsigned*)(header + 1);
+    if (memory_map_pages(mem, mapping, size, header->data_offset, page_numbers, header->num_pages) != MEMORY_OK) {
+        munmap(mapping, size);
+        return CHECKPOINT_FORMAT_ERROR;
+    }
+    return CHECKPOINT_OK;
+}
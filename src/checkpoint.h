@@ -0,0 +1,44 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "memory.h"
+#include "read_elf.h"
+#include "simulate.h"
+#include "syscalls.h"
+#include <stdint.h>
+
+// Checkpoint files: the pages in use, the registers and pc, the guest heap
+// and the program info, so a run can go on later without the ELF file and
+// without running the program's initialization again.
+//
+// The file is a header, the list of page numbers and then the pages
+// themselves, aligned to MEMORY_PAGE_SIZE. Reading maps the file and hands
+// the pages to memory.c as they are (copy-on-write in the host), so restoring
+// costs the same for a small and a large image. The format is the host's own
+// byte order and struct layout; the header size guards against a different build.
+
+#define CHECKPOINT_MAGIC "RVSIMCK1"
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t header_size;     // sizeof(struct checkpoint_header)
+    uint32_t num_pages;
+    uint64_t data_offset;     // of the first page
+    struct program_info info;
+    struct hart hart;
+    struct guest_heap heap;
+};
+
+#define CHECKPOINT_OK            0
+#define CHECKPOINT_OPEN_ERROR   -1    // the file could not be opened or created
+#define CHECKPOINT_FORMAT_ERROR -2    // not a checkpoint from this build
+#define CHECKPOINT_WRITE_ERROR  -3
+
+int checkpoint_write(const char* file_name, struct memory* mem, const struct program_info* info,
+                     const struct hart* hart, const struct guest_heap* heap);
+
+// mem should be empty (fresh from memory_create)
+int checkpoint_read(const char* file_name, struct memory* mem, struct program_info* info,
+                    struct hart* hart, struct guest_heap* heap);
+
+#endif
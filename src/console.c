@@ -0,0 +1,177 @@
+#include "console.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CONSOLE_BUF_SIZE (1 << 16)
+
+struct console {
+    int in_fd;
+    int out_fd;
+    int mode;
+    size_t out_len;
+    size_t in_pos;
+    size_t in_len;
+    int in_eof;
+    off_t in_start;         // offset of in_fd at creation, -1 if it cannot seek
+    char* captured;         // output kept in memory when out_fd < 0
+    size_t captured_len;
+    size_t captured_cap;
+    char out[CONSOLE_BUF_SIZE];
+    char in[CONSOLE_BUF_SIZE];
+};
+
+struct console* console_create(int in_fd, int out_fd, int mode)
+{
+    struct console* console = malloc(sizeof(struct console));
+    if (!console) return NULL;
+    console->in_fd = in_fd;
+    console->out_fd = out_fd;
+    if (mode == CONSOLE_DEFAULT)
+        mode = out_fd >= 0 && isatty(out_fd) ? CONSOLE_LINE : CONSOLE_FULL;
+    console->mode = mode;
+    console->out_len = 0;
+    console->in_pos = 0;
+    console->in_len = 0;
+    console->in_eof = 0;
+    console->in_start = lseek(in_fd, 0, SEEK_CUR);
+    console->captured = NULL;
+    console->captured_len = 0;
+    console->captured_cap = 0;
+    return console;
+}
+
+void console_delete(struct console* console)
+{
+    if (!console) return;
+    console_flush(console);
+    free(console->captured);
+    free(console);
+}
+
+void console_reset(struct console* console)
+{
+    console_flush(console);
+    console->captured_len = 0;
+    console->in_pos = 0;
+    console->in_len = 0;
+    console->in_eof = 0;
+    if (console->in_start >= 0)
+        lseek(console->in_fd, console->in_start, SEEK_SET);
+}
+
+static void write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+static void capture(struct console* console, const char* data, size_t len)
+{
+    if (console->captured_len + len > console->captured_cap) {
+        size_t cap = console->captured_cap ? console->captured_cap : CONSOLE_BUF_SIZE;
+        while (cap < console->captured_len + len)
+            cap *= 2;
+        char* grown = realloc(console->captured, cap);
+        if (!grown) return;
+        console->captured = grown;
+        console->captured_cap = cap;
+    }
+    memcpy(console->captured + console->captured_len, data, len);
+    console->captured_len += len;
+}
+
+static void emit(struct console* console, const char* data, size_t len)
+{
+    if (console->out_fd < 0) capture(console, data, len);
+    else write_all(console->out_fd, data, len);
+}
+
+void console_flush(struct console* console)
+{
+    emit(console, console->out, console->out_len);
+    console->out_len = 0;
+}
+
+const char* console_captured(struct console* console, size_t* len)
+{
+    console_flush(console);
+    *len = console->captured_len;
+    return console->captured ? console->captured : "";
+}
+
+void console_putchar(struct console* console, int c)
+{
+    console->out[console->out_len++] = c;
+    if (console->out_len == CONSOLE_BUF_SIZE
+        || console->mode == CONSOLE_UNBUFFERED
+        || (console->mode == CONSOLE_LINE && c == '\n'))
+        console_flush(console);
+}
+
+long console_write(struct console* console, const void* data, size_t len)
+{
+    if (len > CONSOLE_BUF_SIZE - console->out_len) {
+        console_flush(console);
+        // too big to buffer: hand it to the host as it is
+        if (len >= CONSOLE_BUF_SIZE) {
+            emit(console, data, len);
+            return len;
+        }
+    }
+    memcpy(console->out + console->out_len, data, len);
+    console->out_len += len;
+    if (console->mode == CONSOLE_UNBUFFERED
+        || (console->mode == CONSOLE_LINE && memchr(data, '\n', len)))
+        console_flush(console);
+    return len;
+}
+
+// one host read() into buf, 0 at end of input
+static long read_host(struct console* console, char* buf, size_t len)
+{
+    console_flush(console);
+    if (console->in_eof) return 0;
+    ssize_t got;
+    do {
+        got = read(console->in_fd, buf, len);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+        console->in_eof = 1;
+        return 0;
+    }
+    return got;
+}
+
+int console_getchar(struct console* console)
+{
+    if (console->in_pos == console->in_len) {
+        // unbuffered: take only what is needed, leave the rest for whoever reads next
+        size_t want = console->mode == CONSOLE_UNBUFFERED ? 1 : CONSOLE_BUF_SIZE;
+        long got = read_host(console, console->in, want);
+        if (got == 0) return -1;
+        console->in_pos = 0;
+        console->in_len = got;
+    }
+    return (unsigned char)console->in[console->in_pos++];
+}
+
+long console_read(struct console* console, void* data, size_t len)
+{
+    size_t buffered = console->in_len - console->in_pos;
+    if (buffered == 0)
+        return read_host(console, data, len);
+    // input already read by getchar comes first
+    if (len > buffered) len = buffered;
+    memcpy(data, console->in + console->in_pos, len);
+    console->in_pos += len;
+    return len;
+}
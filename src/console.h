@@ -0,0 +1,45 @@
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <stddef.h>
+
+// Console for the simulated program. Output is collected in a large buffer and
+// handed to the host in one write() when the buffering policy says so; input is
+// read from the host in large blocks.
+//
+// Output is always flushed before the program reads input and when the
+// simulation stops, so prompts and final output are never lost.
+
+enum console_mode {
+    CONSOLE_UNBUFFERED,   // every character is written right away
+    CONSOLE_LINE,         // flush at newline (and when the buffer is full)
+    CONSOLE_FULL          // flush only when the buffer is full
+};
+
+struct console;
+
+// mode CONSOLE_DEFAULT picks line buffering for terminals, full buffering otherwise.
+// With out_fd < 0 the output is kept in memory; see console_captured
+#define CONSOLE_DEFAULT -1
+struct console* console_create(int in_fd, int out_fd, int mode);
+void console_delete(struct console* console);   // flushes pending output
+
+// start over for a new run of the program: pending output is flushed, the
+// output kept in memory is dropped, and input starts again from where the
+// console started reading if in_fd can seek (else from where the host is now)
+void console_reset(struct console* console);
+
+void console_putchar(struct console* console, int c);
+int console_getchar(struct console* console);   // -1 at end of input
+void console_flush(struct console* console);
+
+// all output so far, for a console created with out_fd < 0
+const char* console_captured(struct console* console, size_t* len);
+
+// block transfers for the read/write system calls. console_write returns len,
+// console_read returns the number of bytes read (0 at end of input), at most
+// one host read() per call
+long console_write(struct console* console, const void* data, size_t len);
+long console_read(struct console* console, void* data, size_t len);
+
+#endif
@@ -0,0 +1,3 @@
+#include "decode.h"
+
+#include "isa_tables.inc"
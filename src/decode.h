@@ -0,0 +1,95 @@
+#ifndef __DECODE_H__
+#define __DECODE_H__
+
+#include <stdint.h>
+
+// Instruction formats, as far as operand extraction and printing is concerned
+enum insn_format {
+    FMT_NONE,   // unknown instruction
+    FMT_R,      // op rd, rs1, rs2
+    FMT_I,      // op rd, rs1, imm
+    FMT_SHIFT,  // op rd, rs1, shamt
+    FMT_LOAD,   // op rd, imm(rs1)     (loads and jalr)
+    FMT_S,      // op rs2, imm(rs1)
+    FMT_B,      // op rs1, rs2, target
+    FMT_U,      // op rd, imm
+    FMT_J,      // op rd, target
+    FMT_SYS     // op
+};
+
+// The instruction ids, the decode table and the interpreter handlers are
+// generated by tools/isagen from the instruction description in rv32im.isa
+#include "isa_gen.h"
+
+struct insn_info {
+    const char* mnemonic;
+    uint8_t format;    // enum insn_format
+    uint32_t mask;
+    uint32_t match;
+    uint8_t base;      // the instruction an rd == x0 variant was made from
+};
+
+// A decoded instruction
+struct insn {
+    uint8_t id;        // enum insn_id
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;       // sign extended immediate / shift amount / U-type value
+};
+
+extern const struct insn_info insn_info[NUM_INSNS];
+
+// The decode table is indexed by opcode[6:2], funct3, bits 25 and 30 of funct7 and
+// whether rd is x0. Those bits tell all RV32IM instructions (and their rd == x0
+// variants) apart; the remaining bits are checked against the mask/match of the
+// instruction found.
+extern const uint8_t decode_table[1 << DECODE_KEY_BITS];
+
+static inline uint32_t decode_key(uint32_t instruction)
+{
+    return ((instruction >> 2) & 0x1f) | ((instruction >> 7) & 0xe0)
+         | ((instruction >> 17) & 0x100) | ((instruction >> 21) & 0x200)
+         | (((instruction & 0xf80) == 0) << 10);
+}
+
+static inline int32_t decode_imm(uint32_t instruction, int format)
+{
+    int32_t signed_insn = (int32_t)instruction;
+    switch (format) {
+    case FMT_I:
+    case FMT_LOAD:
+        return signed_insn >> 20;
+    case FMT_SHIFT:
+        return (instruction >> 20) & 0x1f;
+    case FMT_S:
+        return ((signed_insn >> 20) & ~0x1f) | ((instruction >> 7) & 0x1f);
+    case FMT_B:
+        return ((signed_insn >> 19) & ~0xfff) | ((instruction << 4) & 0x800)
+             | ((instruction >> 20) & 0x7e0) | ((instruction >> 7) & 0x1e);
+    case FMT_U:
+        return (int32_t)(instruction & 0xfffff000);
+    case FMT_J:
+        return ((signed_insn >> 11) & ~0xfffff) | (instruction & 0xff000)
+             | ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7fe);
+    default:
+        return 0;
+    }
+}
+
+static inline void decode(uint32_t instruction, struct insn* insn)
+{
+    int id = decode_table[decode_key(instruction)];
+    const struct insn_info* info = &insn_info[id];
+    if ((instruction & info->mask) != info->match) {
+        id = INSN_INVALID;
+        info = &insn_info[id];
+    }
+    insn->id = id;
+    insn->rd = (instruction >> 7) & 0x1f;
+    insn->rs1 = (instruction >> 15) & 0x1f;
+    insn->rs2 = (instruction >> 20) & 0x1f;
+    insn->imm = decode_imm(instruction, info->format);
+}
+
+#endif
@@ -3,4 +3,12 @@
 #include <stdint.h>
 
 struct symbols;
+struct fmt_buf;
+struct insn;
 void disassemble(uint32_t addr, uint32_t instruction, char* result, size_t buf_size, struct symbols* symbols);
+
+// same as disassemble(), but appends the text to an output buffer
+void disassemble_fmt(uint32_t addr, uint32_t instruction, struct fmt_buf* out, struct symbols* symbols);
+
+// same as disassemble_fmt(), for an instruction that has already been decoded
+void disassemble_insn_fmt(uint32_t addr, uint32_t instruction, const struct insn* insn, struct fmt_buf* out, struct symbols* symbols);
@@ -0,0 +1,159 @@
+#include "format.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char hex_lower[16] = "0123456789abcdef";
+static const char hex_upper[16] = "0123456789ABCDEF";
+
+static const char dec_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+void fmt_init(struct fmt_buf* buf, char* storage, size_t cap, int fd)
+{
+    buf->data = storage;
+    buf->len = 0;
+    buf->fd = fd;
+    if (fd < 0) {
+        // keep room for the terminating NUL
+        buf->cap = cap ? cap - 1 : 0;
+        if (cap) storage[0] = 0;
+    } else {
+        buf->cap = cap;
+    }
+}
+
+void fmt_flush(struct fmt_buf* buf)
+{
+    if (buf->fd >= 0 && buf->len) {
+        write_all(buf->fd, buf->data, buf->len);
+        buf->len = 0;
+    }
+}
+
+void fmt_mem(struct fmt_buf* buf, const char* s, size_t n)
+{
+    if (buf->len + n > buf->cap) {
+        if (buf->fd >= 0) {
+            fmt_flush(buf);
+            if (n > buf->cap) {
+                write_all(buf->fd, s, n);
+                return;
+            }
+        } else {
+            n = buf->cap - buf->len;
+        }
+    }
+    memcpy(buf->data + buf->len, s, n);
+    buf->len += n;
+    if (buf->fd < 0 && buf->data) buf->data[buf->len] = 0;
+}
+
+void fmt_str(struct fmt_buf* buf, const char* s)
+{
+    fmt_mem(buf, s, strlen(s));
+}
+
+void fmt_char(struct fmt_buf* buf, char c)
+{
+    if (buf->len < buf->cap) {
+        buf->data[buf->len++] = c;
+        if (buf->fd < 0) buf->data[buf->len] = 0;
+    } else {
+        fmt_mem(buf, &c, 1);
+    }
+}
+
+void fmt_hex(struct fmt_buf* buf, uint32_t value, int width, char pad, int upper)
+{
+    const char* digits = upper ? hex_upper : hex_lower;
+    char tmp[32];
+    if (width > 32) width = 32;
+    // always produce all eight digits, then pick the significant ones
+    char* hex = tmp + 24;
+    for (int i = 0; i < 8; i++)
+        hex[i] = digits[(value >> (28 - 4 * i)) & 0xf];
+    int num_digits = (35 - __builtin_clz(value | 1)) >> 2;
+    int len = num_digits > width ? num_digits : width;
+    memset(tmp + 32 - len, pad, len - num_digits);
+    fmt_mem(buf, tmp + 32 - len, len);
+}
+
+// writes the digits of value so they end just before "end"; returns the first digit
+static char* udec_digits(char* end, uint64_t value)
+{
+    char* p = end;
+    while (value >= 100) {
+        uint64_t pair = value % 100;
+        value /= 100;
+        p -= 2;
+        memcpy(p, dec_pairs + 2 * pair, 2);
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, dec_pairs + 2 * value, 2);
+    } else {
+        *--p = '0' + value;
+    }
+    return p;
+}
+
+void fmt_udec(struct fmt_buf* buf, uint64_t value)
+{
+    char tmp[20];
+    char* p = udec_digits(tmp + sizeof(tmp), value);
+    fmt_mem(buf, p, tmp + sizeof(tmp) - p);
+}
+
+void fmt_udec_pad(struct fmt_buf* buf, uint64_t value, int width)
+{
+    char tmp[52];
+    char* p = udec_digits(tmp + sizeof(tmp), value);
+    if (width > 32) width = 32;
+    while (tmp + sizeof(tmp) - p < width)
+        *--p = ' ';
+    fmt_mem(buf, p, tmp + sizeof(tmp) - p);
+}
+
+void fmt_dec(struct fmt_buf* buf, int64_t value)
+{
+    uint64_t magnitude = value;
+    if (value < 0) {
+        fmt_char(buf, '-');
+        magnitude = 0u - magnitude;
+    }
+    fmt_udec(buf, magnitude);
+}
+
+void fmt_fill(struct fmt_buf* buf, char c, int count)
+{
+    char tmp[64];
+    memset(tmp, c, sizeof(tmp));
+    while (count > 0) {
+        int n = count < (int)sizeof(tmp) ? count : (int)sizeof(tmp);
+        fmt_mem(buf, tmp, n);
+        count -= n;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only text buffer used for disassembly and log output.
+// With fd >= 0 the contents are handed to write() in one call whenever the
+// buffer fills up (and on fmt_flush). With fd < 0 the buffer is a plain
+// string buffer: output beyond the capacity is dropped and the contents are
+// always kept NUL-terminated.
+struct fmt_buf {
+    char* data;
+    size_t len;
+    size_t cap;
+    int fd;
+};
+
+void fmt_init(struct fmt_buf* buf, char* storage, size_t cap, int fd);
+void fmt_flush(struct fmt_buf* buf);
+
+void fmt_mem(struct fmt_buf* buf, const char* s, size_t n);
+void fmt_str(struct fmt_buf* buf, const char* s);
+void fmt_char(struct fmt_buf* buf, char c);
+
+// hex number, right aligned in 'width' characters padded with 'pad'
+// (width 0 gives the minimal number of digits, like "%x")
+void fmt_hex(struct fmt_buf* buf, uint32_t value, int width, char pad, int upper);
+
+// signed/unsigned decimal numbers, like "%d" and "%u"
+void fmt_dec(struct fmt_buf* buf, int64_t value);
+void fmt_udec(struct fmt_buf* buf, uint64_t value);
+
+// unsigned decimal number right aligned in 'width' characters, like "%6lu"
+void fmt_udec_pad(struct fmt_buf* buf, uint64_t value, int width);
+
+// 'count' copies of the character c
+void fmt_fill(struct fmt_buf* buf, char c, int count);
+
+#endif
@@ -0,0 +1,281 @@
+#include "intercept.h"
+#include <stdlib.h>
+#include <string.h>
+
+// guest memory is copied and scanned through host buffers of this size
+#define BLOCK (1 << 12)
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// memmove(dst, src, n); memcpy is the same. The copy goes through a host
+// buffer a block at a time, backwards if the destination overlaps the source
+// from above, and uses the host's memcpy within each page.
+static int host_memmove(struct syscall_context* ctx)
+{
+    uint32_t dst = ctx->regs[REG_A0];
+    uint32_t src = ctx->regs[REG_A1];
+    uint32_t n = ctx->regs[REG_A2];
+    char block[BLOCK];
+    if (dst - src >= n) {
+        for (uint32_t done = 0; done < n; ) {
+            uint32_t chunk = min_u32(n - done, BLOCK);
+            memory_rd_block(ctx->mem, src + done, block, chunk);
+            memory_wr_block(ctx->mem, dst + done, block, chunk);
+            done += chunk;
+        }
+    } else {
+        for (uint32_t left = n; left > 0; ) {
+            uint32_t chunk = min_u32(left, BLOCK);
+            left -= chunk;
+            memory_rd_block(ctx->mem, src + left, block, chunk);
+            memory_wr_block(ctx->mem, dst + left, block, chunk);
+        }
+    }
+    predecode_update_range(ctx->pd, dst, n, ctx->mem);
+    ctx->bytes = n;
+    return 1;
+}
+
+// memset(dst, c, n)
+static int host_memset(struct syscall_context* ctx)
+{
+    uint32_t dst = ctx->regs[REG_A0];
+    uint32_t n = ctx->regs[REG_A2];
+    memory_set_block(ctx->mem, dst, ctx->regs[REG_A1], n);
+    predecode_update_range(ctx->pd, dst, n, ctx->mem);
+    ctx->bytes = n;
+    return 1;
+}
+
+// bytes from addr to the end of its BLOCK aligned block. Scans read no further
+// than that at a time, so they stop in the page of the terminator
+static uint32_t to_block_end(uint32_t addr)
+{
+    return BLOCK - addr % BLOCK;
+}
+
+// length of the string at addr
+static uint32_t guest_strlen(struct memory* mem, uint32_t addr)
+{
+    char block[BLOCK];
+    for (uint32_t len = 0; ; ) {
+        uint32_t chunk = to_block_end(addr + len);
+        memory_rd_block(mem, addr + len, block, chunk);
+        const char* end = memchr(block, 0, chunk);
+        if (end)
+            return len + (end - block);
+        len += chunk;
+    }
+}
+
+static int host_strlen(struct syscall_context* ctx)
+{
+    uint32_t len = guest_strlen(ctx->mem, ctx->regs[REG_A0]);
+    ctx->regs[REG_A0] = len;
+    ctx->bytes = len + 1;
+    return 1;
+}
+
+// strcmp(a, b): the difference of the first differing bytes, as unsigned chars
+static int host_strcmp(struct syscall_context* ctx)
+{
+    uint32_t a = ctx->regs[REG_A0];
+    uint32_t b = ctx->regs[REG_A1];
+    unsigned char block_a[BLOCK], block_b[BLOCK];
+    for (uint32_t offset = 0; ; ) {
+        uint32_t chunk = min_u32(to_block_end(a + offset), to_block_end(b + offset));
+        memory_rd_block(ctx->mem, a + offset, block_a, chunk);
+        memory_rd_block(ctx->mem, b + offset, block_b, chunk);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (block_a[i] != block_b[i] || block_a[i] == 0) {
+                ctx->regs[REG_A0] = (int32_t)block_a[i] - (int32_t)block_b[i];
+                ctx->bytes = offset + i + 1;
+                return 1;
+            }
+        }
+        offset += chunk;
+    }
+}
+
+// print_string(s): putchar of every character in s
+static int host_print_string(struct syscall_context* ctx)
+{
+    uint32_t s = ctx->regs[REG_A0];
+    uint32_t len = guest_strlen(ctx->mem, s);
+    char block[BLOCK];
+    for (uint32_t done = 0; done < len; ) {
+        uint32_t chunk = min_u32(len - done, BLOCK);
+        memory_rd_block(ctx->mem, s + done, block, chunk);
+        console_write(ctx->console, block, chunk);
+        done += chunk;
+    }
+    ctx->bytes = len;
+    return 1;
+}
+
+// str_to_uns(s): decimal digits to unsigned, exactly as the guest version
+// computes it (no checks, the first character is always taken as a digit)
+static int host_str_to_uns(struct syscall_context* ctx)
+{
+    uint32_t s = ctx->regs[REG_A0];
+    uint32_t start = s;
+    uint32_t result = memory_rd_b(ctx->mem, s) - '0';
+    for (uint32_t c; (c = memory_rd_b(ctx->mem, ++s)) != 0; )
+        result = result * 10 + c - '0';
+    ctx->regs[REG_A0] = result;
+    ctx->bytes = s - start;
+    return 1;
+}
+
+// uns_to_str(buf, value): value as a decimal string in buf. Like the guest
+// version it returns the index of the last digit, except 1 for zero
+static int host_uns_to_str(struct syscall_context* ctx)
+{
+    uint32_t buf = ctx->regs[REG_A0];
+    uint32_t value = ctx->regs[REG_A1];
+    char digits[12];
+    uint32_t len;
+    if (value == 0) {
+        memcpy(digits, "0", 2);
+        len = 2;
+        ctx->regs[REG_A0] = 1;
+    } else {
+        char reversed[10];
+        uint32_t n = 0;
+        for (; value; value /= 10)
+            reversed[n++] = '0' + value % 10;
+        for (uint32_t i = 0; i < n; i++)
+            digits[i] = reversed[n - 1 - i];
+        digits[n] = 0;
+        len = n + 1;
+        ctx->regs[REG_A0] = n - 1;
+    }
+    memory_wr_block(ctx->mem, buf, digits, len);
+    predecode_update_range(ctx->pd, buf, len, ctx->mem);
+    ctx->bytes = len;
+    return 1;
+}
+
+// The instruction estimates are those of the simple byte loops the course
+// library and a non-vectorized libc use: a load, a store or compare, the
+// pointer and counter updates and the branch per byte, plus call and return.
+// print_string pays a putchar call per character, uns_to_str a divu and a
+// remu per digit.
+static const struct {
+    const char* name;
+    syscall_handler handler;
+    int insns_per_call;
+    int insns_per_byte;
+} builtin[] = {
+    { "memcpy", host_memmove, 4, 5 },
+    { "memmove", host_memmove, 6, 5 },
+    { "memset", host_memset, 4, 4 },
+    { "strlen", host_strlen, 4, 4 },
+    { "strcmp", host_strcmp, 4, 7 },
+    { "print_string", host_print_string, 6, 8 },
+    { "str_to_uns", host_str_to_uns, 5, 6 },
+    { "uns_to_str", host_uns_to_str, 12, 12 },
+};
+
+struct intercepts* intercepts_create(void)
+{
+    struct intercepts* intercepts = calloc(1, sizeof(struct intercepts));
+    if (!intercepts) return NULL;
+    for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+        intercepts_register(intercepts, builtin[i].name, builtin[i].handler);
+        struct intercept* entry = &intercepts->entries[intercepts->count - 1];
+        entry->insns_per_call = builtin[i].insns_per_call;
+        entry->insns_per_byte = builtin[i].insns_per_byte;
+    }
+    return intercepts;
+}
+
+void intercepts_delete(struct intercepts* intercepts)
+{
+    free(intercepts);
+}
+
+int intercepts_register(struct intercepts* intercepts, const char* name, syscall_handler handler)
+{
+    struct intercept* entry = NULL;
+    for (int i = 0; i < intercepts->count; i++) {
+        if (!strcmp(intercepts->entries[i].name, name))
+            entry = &intercepts->entries[i];
+    }
+    if (!entry) {
+        if (intercepts->count == INTERCEPT_MAX) return 0;
+        entry = &intercepts->entries[intercepts->count++];
+    }
+    entry->name = name;
+    entry->handler = handler;
+    entry->addr = 0;
+    entry->calls = 0;
+    entry->bytes = 0;
+    entry->insns_per_call = 0;
+    entry->insns_per_byte = 0;
+    return 1;
+}
+
+int intercepts_install(struct intercepts* intercepts, struct symbols* symbols, struct predecode* pd)
+{
+    int found = 0;
+    for (int i = 0; i < intercepts->count; i++) {
+        struct intercept* entry = &intercepts->entries[i];
+        unsigned int addr;
+        if (!symbols_sym_to_value(symbols, entry->name, &addr))
+            continue;
+        int64_t index = predecode_index(pd, addr);
+        if (index < 0)
+            continue;
+        entry->addr = addr;
+        pd->id[index] = INSN_INTERCEPT;
+        found++;
+    }
+    return found;
+}
+
+static struct intercept* find(struct intercepts* intercepts, uint32_t pc)
+{
+    for (int i = 0; i < intercepts->count; i++) {
+        if (intercepts->entries[i].addr == pc)
+            return &intercepts->entries[i];
+    }
+    return NULL;
+}
+
+int intercepts_call(struct intercepts* intercepts, uint32_t pc, struct syscall_context* ctx, long* guest_insns)
+{
+    struct intercept* entry = intercepts ? find(intercepts, pc) : NULL;
+    if (!entry)
+        return -1;
+    entry->calls++;
+    ctx->bytes = 0;
+    int result = entry->handler(ctx);
+    entry->bytes += ctx->bytes;
+    *guest_insns = entry->insns_per_call + (long)entry->insns_per_byte * ctx->bytes;
+    return result;
+}
+
+const char* intercepts_name(struct intercepts* intercepts, uint32_t pc)
+{
+    struct intercept* entry = intercepts ? find(intercepts, pc) : NULL;
+    return entry ? entry->name : "?";
+}
+
+void intercepts_print_summary(struct intercepts* intercepts, FILE* out)
+{
+    int header = 0;
+    for (int i = 0; i < intercepts->count; i++) {
+        struct intercept* entry = &intercepts->entries[i];
+        if (!entry->calls) continue;
+        if (!header) {
+            fprintf(out, "\nHost functions           calls        bytes  est. guest insns\n");
+            header = 1;
+        }
+        long guest_insns = entry->insns_per_call * entry->calls + entry->insns_per_byte * entry->bytes;
+        fprintf(out, "  %-16s %12ld %12ld  %16ld\n", entry->name, entry->calls, entry->bytes, guest_insns);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __INTERCEPT_H__
+#define __INTERCEPT_H__
+
+#include "syscalls.h"
+#include "read_elf.h"
+#include "predecode.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Host implementations of guest library functions. Once installed, a call to
+// the guest function runs the host version instead (over simulated memory)
+// and returns straight to ra. The entry instruction is marked in the
+// predecoded text with INSN_INTERCEPT, so other instructions pay nothing.
+//
+// Host functions have the signature of system call handlers: arguments in
+// a0.., result in a0, return 0 to stop the simulation. They set ctx->bytes to
+// the number of bytes they worked on, from which the guest instructions the
+// call saved are estimated.
+
+#define INSN_INTERCEPT NUM_INSNS
+#define REG_RA 1
+
+#define INTERCEPT_MAX 32
+
+struct intercept {
+    const char* name;
+    syscall_handler handler;
+    uint32_t addr;          // entry of the guest function, 0 if not found
+    long calls;
+    long bytes;             // ctx->bytes over all calls
+    // the guest version's instructions per call and per byte, for the
+    // estimate; 0 (not estimated) for functions added with intercepts_register
+    int insns_per_call;
+    int insns_per_byte;
+};
+
+struct intercepts {
+    int count;
+    struct intercept entries[INTERCEPT_MAX];
+};
+
+// a table with host versions of memcpy, memmove, memset, strlen, strcmp and
+// the print_string, str_to_uns and uns_to_str helpers of the course library
+struct intercepts* intercepts_create(void);
+void intercepts_delete(struct intercepts* intercepts);
+
+// add (or replace) the host version of the guest function 'name'; returns 0 if the table is full
+int intercepts_register(struct intercepts* intercepts, const char* name, syscall_handler handler);
+
+// look the functions up in the program's symbols and mark their entries in
+// the predecoded text; returns the number of functions found
+int intercepts_install(struct intercepts* intercepts, struct symbols* symbols, struct predecode* pd);
+
+// run the host version of the function at pc; returns 0 if the simulation
+// should stop, -1 if no function is installed at pc. *guest_insns is the
+// estimate of the instructions the guest version would have run
+int intercepts_call(struct intercepts* intercepts, uint32_t pc, struct syscall_context* ctx, long* guest_insns);
+
+// the intercepted function at pc, for the execution log
+const char* intercepts_name(struct intercepts* intercepts, uint32_t pc);
+
+// calls, bytes and estimated guest instructions per intercepted function, for the summary
+void intercepts_print_summary(struct intercepts* intercepts, FILE* out);
+
+#endif
@@ -0,0 +1,443 @@
+#include "libsim.h"
+#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct sim {
+    struct sim_options options;
+    struct console* console;
+    // the loaded program
+    char* elf_file;
+    char* checkpoint_file;      // instead of elf_file after sim_restore
+    int num_args;
+    char** args;
+    struct memory* mem;
+    struct program_info info;
+    struct symbols* symbols;
+    struct predecode* pd;
+    struct syscalls* syscalls;
+    struct intercepts* intercepts;
+    struct profile* profile;
+    struct bbv* bbv;
+    struct hart hart;
+    struct Stat stats;
+    struct sim_times times;
+    int have_snapshot;          // sim_reset loads the program again until there is one
+};
+
+// what memory_snapshot saves besides the memory
+struct sim_state {
+    struct hart hart;
+    struct guest_heap heap;
+};
+
+static double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// adds the time since *start to *phase and restarts the clock
+static void lap(double* start, double* phase)
+{
+    double t = now(CLOCK_MONOTONIC);
+    *phase += t - *start;
+    *start = t;
+}
+
+void sim_default_options(struct sim_options* options)
+{
+    options->in_fd = STDIN_FILENO;
+    options->out_fd = STDOUT_FILENO;
+    options->console_mode = CONSOLE_DEFAULT;
+    options->log_file = NULL;
+    options->intercept = 0;
+    options->timed_syscalls = 0;
+    options->stats = 0;
+    options->count_branches = 0;
+    options->profile = 0;
+    options->bbv_file = NULL;
+    options->bbv_interval = 100000000;
+}
+
+struct sim* sim_create(const struct sim_options* options)
+{
+    struct sim* sim = calloc(1, sizeof(struct sim));
+    if (!sim) return NULL;
+    if (options) sim->options = *options;
+    else sim_default_options(&sim->options);
+    sim->console = console_create(sim->options.in_fd, sim->options.out_fd, sim->options.console_mode);
+    if (!sim->console) {
+        free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+// the loaded program's memory and tables
+static void unload(struct sim* sim)
+{
+    bbv_delete(sim->bbv);
+    profile_delete(sim->profile);
+    intercepts_delete(sim->intercepts);
+    syscalls_delete(sim->syscalls);
+    predecode_delete(sim->pd);
+    if (sim->mem) memory_delete(sim->mem);
+    sim->bbv = NULL;
+    sim->profile = NULL;
+    sim->intercepts = NULL;
+    sim->syscalls = NULL;
+    sim->pd = NULL;
+    sim->mem = NULL;
+    sim->have_snapshot = 0;
+}
+
+static void forget_program(struct sim* sim)
+{
+    unload(sim);
+    symbols_delete(sim->symbols);
+    sim->symbols = NULL;
+    for (int i = 0; i < sim->num_args; i++)
+        free(sim->args[i]);
+    free(sim->args);
+    free(sim->elf_file);
+    free(sim->checkpoint_file);
+    sim->args = NULL;
+    sim->num_args = 0;
+    sim->elf_file = NULL;
+    sim->checkpoint_file = NULL;
+}
+
+void sim_destroy(struct sim* sim)
+{
+    if (!sim) return;
+    forget_program(sim);
+    console_delete(sim->console);
+    free(sim);
+}
+
+// program arguments, heap and registers for a run from the start
+static void start_program(struct sim* sim)
+{
+    if (sim->num_args)
+        program_args_to_memory(sim->mem, sim->num_args, sim->args);
+    syscalls_init_heap(sim->syscalls, sim->info.data_end);
+    hart_init(&sim->hart, sim->info.start);
+    memory_clear_touched(sim->mem);
+}
+
+// load sim->elf_file into fresh memory and get ready to run it from the start
+static int load(struct sim* sim)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    double t = now(CLOCK_MONOTONIC);
+    sim->mem = memory_create();
+    sim->syscalls = syscalls_create(sim->options.timed_syscalls);
+    if (!sim->mem || !sim->syscalls)
+        return SIM_ERR_NO_MEMORY;
+    lap(&t, &sim->times.memory_create);
+    int result = read_elf(sim->mem, &sim->info, sim->elf_file, sim->options.log_file);
+    lap(&t, &sim->times.read_elf);
+    switch (result) {
+    case READ_ELF_OK:
+        break;
+    case READ_ELF_OPEN_ERROR:
+        return SIM_ERR_OPEN;
+    case READ_ELF_NO_MEMORY:
+        return SIM_ERR_NO_MEMORY;
+    default:
+        return SIM_ERR_ELF;
+    }
+    sim->pd = predecode_create(sim->mem, &sim->info);
+    if (!sim->pd)
+        return SIM_ERR_NO_MEMORY;
+    if (sim->options.intercept) {
+        sim->intercepts = intercepts_create();
+        if (!sim->intercepts)
+            return SIM_ERR_NO_MEMORY;
+        if (sim->symbols)
+            intercepts_install(sim->intercepts, sim->symbols, sim->pd);
+    }
+    if (sim->options.profile && !(sim->profile = profile_create(sim->pd)))
+        return SIM_ERR_NO_MEMORY;
+    if (sim->options.bbv_file && !(sim->bbv = bbv_create(sim->pd, sim->options.bbv_interval, sim->options.bbv_file)))
+        return SIM_ERR_NO_MEMORY;
+    lap(&t, &sim->times.predecode);
+    start_program(sim);
+    lap(&t, &sim->times.args);
+    // no snapshot yet: most runs are never reset, and writes to pages shared
+    // with a snapshot cost a copy each
+    return SIM_OK;
+}
+
+int sim_load(struct sim* sim, const char* elf_file, int num_args, char* args[])
+{
+    forget_program(sim);
+    memset(&sim->times, 0, sizeof(sim->times));
+    sim->elf_file = strdup(elf_file);
+    sim->args = calloc(num_args + 1, sizeof(char*));
+    if (!sim->elf_file || !sim->args)
+        goto no_memory;
+    for (; sim->num_args < num_args; sim->num_args++) {
+        sim->args[sim->num_args] = strdup(args[sim->num_args]);
+        if (!sim->args[sim->num_args])
+            goto no_memory;
+    }
+    double t = now(CLOCK_MONOTONIC);
+    sim->symbols = symbols_read_from_elf(elf_file);
+    lap(&t, &sim->times.symbols);
+    int result = load(sim);
+    if (result != SIM_OK)
+        forget_program(sim);
+    return result;
+
+no_memory:
+    forget_program(sim);
+    return SIM_ERR_NO_MEMORY;
+}
+
+int sim_restore(struct sim* sim, const char* file_name)
+{
+    forget_program(sim);
+    memset(&sim->times, 0, sizeof(sim->times));
+    double t = now(CLOCK_MONOTONIC);
+    sim->mem = memory_create();
+    sim->syscalls = syscalls_create(sim->options.timed_syscalls);
+    int result = SIM_ERR_NO_MEMORY;
+    if (!sim->mem || !sim->syscalls)
+        goto fail;
+    lap(&t, &sim->times.memory_create);
+    int read = checkpoint_read(file_name, sim->mem, &sim->info, &sim->hart, &sim->syscalls->heap);
+    lap(&t, &sim->times.read_elf);
+    switch (read) {
+    case CHECKPOINT_OK:
+        break;
+    case CHECKPOINT_OPEN_ERROR:
+        result = SIM_ERR_OPEN;
+        goto fail;
+    default:
+        result = SIM_ERR_CHECKPOINT;
+        goto fail;
+    }
+    sim->pd = predecode_create(sim->mem, &sim->info);
+    if (!sim->pd)
+        goto fail;
+    if (sim->options.profile && !(sim->profile = profile_create(sim->pd)))
+        goto fail;
+    if (sim->options.bbv_file && !(sim->bbv = bbv_create(sim->pd, sim->options.bbv_interval, sim->options.bbv_file)))
+        goto fail;
+    lap(&t, &sim->times.predecode);
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    memory_clear_touched(sim->mem);
+    sim->checkpoint_file = strdup(file_name);
+    if (sim->checkpoint_file)
+        return SIM_OK;
+fail:
+    forget_program(sim);
+    return result;
+}
+
+int sim_save_checkpoint(struct sim* sim, const char* file_name)
+{
+    if (!sim->mem)
+        return SIM_ERR_NOT_LOADED;
+    switch (checkpoint_write(file_name, sim->mem, &sim->info, &sim->hart, &sim->syscalls->heap)) {
+    case CHECKPOINT_OK:
+        return SIM_OK;
+    case CHECKPOINT_OPEN_ERROR:
+        return SIM_ERR_OPEN;
+    default:
+        return SIM_ERR_WRITE;
+    }
+}
+
+int sim_snapshot(struct sim* sim)
+{
+    if (!sim->mem)
+        return SIM_ERR_NOT_LOADED;
+    struct sim_state state = { sim->hart, sim->syscalls->heap };
+    if (memory_snapshot(sim->mem, &state, sizeof(state)) != MEMORY_OK)
+        return SIM_ERR_NO_MEMORY;
+    sim->have_snapshot = 1;
+    return SIM_OK;
+}
+
+// the program as sim_load or sim_restore left it, in the same memory and
+// tables, so pointers from sim_memory() etc. stay valid
+static int reload(struct sim* sim)
+{
+    memory_clear(sim->mem);
+    if (sim->checkpoint_file) {
+        switch (checkpoint_read(sim->checkpoint_file, sim->mem, &sim->info, &sim->hart, &sim->syscalls->heap)) {
+        case CHECKPOINT_OK:
+            break;
+        case CHECKPOINT_OPEN_ERROR:
+            return SIM_ERR_OPEN;
+        default:
+            return SIM_ERR_CHECKPOINT;
+        }
+    } else {
+        switch (read_elf(sim->mem, &sim->info, sim->elf_file, sim->options.log_file)) {
+        case READ_ELF_OK:
+            break;
+        case READ_ELF_OPEN_ERROR:
+            return SIM_ERR_OPEN;
+        case READ_ELF_NO_MEMORY:
+            return SIM_ERR_NO_MEMORY;
+        default:
+            return SIM_ERR_ELF;
+        }
+        start_program(sim);
+    }
+    predecode_update_range(sim->pd, sim->info.text_start, sim->info.text_end - sim->info.text_start, sim->mem);
+    if (sim->intercepts && sim->symbols)
+        intercepts_install(sim->intercepts, sim->symbols, sim->pd);
+    return SIM_OK;
+}
+
+int sim_reset(struct sim* sim)
+{
+    if (!sim->mem)
+        return SIM_ERR_NOT_LOADED;
+    if (!sim->have_snapshot) {
+        // the first reset loads the program again and keeps that for the next
+        double t = now(CLOCK_MONOTONIC);
+        int result = reload(sim);
+        if (result == SIM_OK)
+            result = sim_snapshot(sim);
+        if (result != SIM_OK) {
+            unload(sim);
+            return result;
+        }
+        lap(&t, &sim->times.snapshot);
+    } else {
+        // text pages the program wrote to must be decoded again
+        uint32_t text_start = sim->info.text_start & ~(MEMORY_PAGE_SIZE - 1);
+        int text_dirty = 0;
+        for (uint32_t addr = text_start; addr < sim->info.text_end; addr += MEMORY_PAGE_SIZE)
+            text_dirty |= memory_page_dirty(sim->mem, addr);
+        struct sim_state state;
+        memory_restore(sim->mem, &state);
+        if (text_dirty) {
+            predecode_update_range(sim->pd, sim->info.text_start, sim->info.text_end - sim->info.text_start, sim->mem);
+            if (sim->intercepts && sim->symbols)
+                intercepts_install(sim->intercepts, sim->symbols, sim->pd);
+        }
+        sim->hart = state.hart;
+        sim->syscalls->heap = state.heap;
+    }
+    for (int i = 0; i < SYSCALL_MAX; i++) {
+        sim->syscalls->entries[i].count = 0;
+        sim->syscalls->entries[i].host_ns = 0;
+    }
+    if (sim->intercepts)
+        for (int i = 0; i < sim->intercepts->count; i++)
+        {
+            sim->intercepts->entries[i].calls = 0;
+            sim->intercepts->entries[i].bytes = 0;
+        }
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    memory_clear_touched(sim->mem);
+    console_reset(sim->console);
+    if (sim->profile)
+        profile_clear(sim->profile);
+    sim_flush_bbv(sim);
+    sim->times.run = 0;
+    sim->times.run_cpu = 0;
+    return SIM_OK;
+}
+
+int sim_run(struct sim* sim, long int max_insns)
+{
+    if (!sim->mem)
+        return SIM_ERR_NOT_LOADED;
+    if (!sim->hart.halted) {
+        double start = now(CLOCK_MONOTONIC);
+        double start_cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+        int collect_stats = sim->options.stats ? STATS_ALL : sim->options.count_branches ? STATS_BRANCHES : STATS_NONE;
+        struct Stat run = simulate_hart(&sim->hart, max_insns, sim->mem, sim->options.log_file, collect_stats,
+                                        sim->profile, sim->bbv, sim->symbols,
+                                        sim->pd, sim->console, sim->syscalls, sim->intercepts);
+        simulate_add_stats(&sim->stats, &run);
+        sim->times.run_cpu += now(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+        sim->times.run += now(CLOCK_MONOTONIC) - start;
+    }
+    if (!sim->hart.halted)
+        return SIM_STOPPED;
+    return sim->stats.fault ? SIM_FAULTED : SIM_EXITED;
+}
+
+int sim_run_until(struct sim* sim, uint32_t addr, long int max_insns)
+{
+    if (!sim->mem)
+        return SIM_ERR_NOT_LOADED;
+    int64_t index = predecode_index(sim->pd, addr);
+    if (index < 0)
+        return SIM_ERR_NO_TEXT;
+    // a breakpoint in the predecoded text, see INSN_BREAKPOINT
+    uint8_t id = sim->pd->id[index];
+    sim->pd->id[index] = INSN_BREAKPOINT;
+    int result = sim_run(sim, max_insns);
+    // the program may have replaced the instruction meanwhile
+    if (sim->pd->id[index] == INSN_BREAKPOINT)
+        sim->pd->id[index] = id;
+    return result;
+}
+
+const struct Stat* sim_stats(struct sim* sim)
+{
+    return &sim->stats;
+}
+
+void sim_flush_bbv(struct sim* sim)
+{
+    if (sim->bbv)
+        bbv_flush(sim->bbv);
+}
+
+const struct sim_times* sim_times(struct sim* sim)
+{
+    return &sim->times;
+}
+
+const char* sim_output(struct sim* sim, size_t* len)
+{
+    return console_captured(sim->console, len);
+}
+
+void sim_print_summary(struct sim* sim, FILE* out)
+{
+    if (!sim->mem) return;
+    if (sim->options.stats) simulate_print_stats(out, &sim->stats);
+    syscalls_print_summary(sim->syscalls, out);
+    if (sim->intercepts) intercepts_print_summary(sim->intercepts, out);
+    fprintf(out, "\nHost memory: %d pages of 64 KiB at peak, %d at exit\n",
+            memory_peak_pages(sim->mem), memory_pages_in_use(sim->mem));
+}
+
+const char* sim_error_string(int error)
+{
+    switch (error) {
+    case SIM_OK: return "No error";
+    case SIM_ERR_NO_MEMORY: return "Out of host memory";
+    case SIM_ERR_OPEN: return "Could not open the ELF file";
+    case SIM_ERR_ELF: return "Not a valid RISC-V ELF file";
+    case SIM_ERR_NOT_LOADED: return "No program loaded";
+    case SIM_ERR_CHECKPOINT: return "Not a valid checkpoint file";
+    case SIM_ERR_WRITE: return "Could not write the checkpoint";
+    case SIM_ERR_NO_TEXT: return "Address outside the text segment";
+    default: return "Unknown error";
+    }
+}
+
+struct hart* sim_hart(struct sim* sim) { return &sim->hart; }
+struct memory* sim_memory(struct sim* sim) { return sim->mem; }
+struct predecode* sim_predecode(struct sim* sim) { return sim->pd; }
+struct symbols* sim_symbols(struct sim* sim) { return sim->symbols; }
+const struct program_info* sim_program_info(struct sim* sim) { return &sim->info; }
+struct syscalls* sim_syscalls(struct sim* sim) { return sim->syscalls; }
+struct intercepts* sim_intercepts(struct sim* sim) { return sim->intercepts; }
+struct profile* sim_profile(struct sim* sim) { return sim->profile; }
@@ -0,0 +1,131 @@
+#ifndef __LIBSIM_H__
+#define __LIBSIM_H__
+
+#include "memory.h"
+#include "read_elf.h"
+#include "predecode.h"
+#include "console.h"
+#include "syscalls.h"
+#include "intercept.h"
+#include "simulate.h"
+#include <stdio.h>
+
+// The simulator as a library. A struct sim holds everything one simulated
+// program needs, so any number of them can live side by side in one process
+// (one thread per sim at a time). Nothing in here calls exit() or writes to
+// stdout; errors come back as negative codes.
+//
+//   struct sim* sim = sim_create(NULL);
+//   if (sim_load(sim, "prog.riscv", 0, NULL) == SIM_OK)
+//       while (sim_run(sim, 1000000) == SIM_STOPPED)
+//           ;   // look at sim_stats(sim), sim_hart(sim) ...
+//   sim_destroy(sim);
+
+// sim_run results
+#define SIM_STOPPED   1     // max_insns reached, sim_run can go on
+#define SIM_EXITED    2     // the program called exit
+#define SIM_FAULTED   3     // stopped on a fault, see sim_stats()->fault
+
+// error codes
+#define SIM_OK                 0
+#define SIM_ERR_NO_MEMORY     -1
+#define SIM_ERR_OPEN          -2    // the ELF file could not be opened
+#define SIM_ERR_ELF           -3    // not a valid ELF file
+#define SIM_ERR_NOT_LOADED    -4    // no program loaded
+#define SIM_ERR_CHECKPOINT    -5    // not a valid checkpoint file
+#define SIM_ERR_WRITE         -6    // the checkpoint could not be written
+#define SIM_ERR_NO_TEXT       -7    // the address is not in the text segment
+
+struct sim_options {
+    int in_fd;              // the program's stdin
+    int out_fd;             // its stdout; < 0 keeps the output in memory (see sim_output)
+    int console_mode;       // enum console_mode or CONSOLE_DEFAULT
+    FILE* log_file;         // execution log, NULL for none
+    int intercept;          // run memcpy, strlen etc. as host functions (see intercept.h)
+    int timed_syscalls;     // measure host time per system call
+    int stats;              // count the instruction classes, mix etc. of struct Stat (a slower interpreter)
+    int count_branches;     // count only the branches of struct Stat (nearly as fast as no statistics)
+    int profile;            // count executions per instruction, see sim_profile (also counts stats)
+    FILE* bbv_file;         // SimPoint basic block vectors (see bbv.h), NULL for none
+    long int bbv_interval;  // instructions per vector
+};
+
+// stdin/stdout of the host, default buffering, no log, no extra statistics
+void sim_default_options(struct sim_options* options);
+
+struct sim;
+
+// options may be NULL for the defaults. NULL if out of memory
+struct sim* sim_create(const struct sim_options* options);
+void sim_destroy(struct sim* sim);
+
+// load the ELF file with arguments args[0 .. num_args) (args[0] is '--' by
+// convention, see program_args_to_memory). A missing symbol table is not an error
+int sim_load(struct sim* sim, const char* elf_file, int num_args, char* args[]);
+
+// simulate at most max_insns instructions (all if negative). Returns
+// SIM_STOPPED, SIM_EXITED, SIM_FAULTED or an error code
+int sim_run(struct sim* sim, long int max_insns);
+
+// run until the program reaches 'addr' (stopping in front of that instruction)
+// or max_insns instructions have run; SIM_STOPPED in both cases, see sim_hart()->pc
+int sim_run_until(struct sim* sim, uint32_t addr, long int max_insns);
+
+// write the current state to a checkpoint file (see checkpoint.h)
+int sim_save_checkpoint(struct sim* sim, const char* file_name);
+
+// instead of sim_load: go on from a checkpoint. There are no symbols, so
+// options->intercept has no effect
+int sim_restore(struct sim* sim, const char* file_name);
+
+// back to the state right after sim_load (or sim_restore), or the last sim_snapshot; the
+// statistics and the console start over (see console_reset). Loading takes no snapshot, so the first reset loads
+// the program again (into the same memory) and takes one then; after that only
+// the memory pages written since are restored (see memory_snapshot), so a
+// reset takes microseconds. A failed reset leaves nothing loaded
+int sim_reset(struct sim* sim);
+
+// make the current state the one sim_reset goes back to, e.g. after the
+// program's own initialization
+int sim_snapshot(struct sim* sim);
+
+// totals over all sim_run calls since load or reset
+const struct Stat* sim_stats(struct sim* sim);
+
+// host time in seconds for the phases of sim_load/sim_restore and for
+// sim_run, from CLOCK_MONOTONIC (CLOCK_PROCESS_CPUTIME_ID for run_cpu)
+struct sim_times {
+    double memory_create;   // memory and system call tables
+    double read_elf;        // or checkpoint_read for sim_restore
+    double symbols;
+    double predecode;       // including the intercepts
+    double args;            // program arguments to memory
+    double snapshot;        // by the first sim_reset, see there
+    double run;             // all sim_run calls since load or reset
+    double run_cpu;
+};
+const struct sim_times* sim_times(struct sim* sim);
+
+// output so far, for a sim created with out_fd < 0
+const char* sim_output(struct sim* sim, size_t* len);
+
+// the instruction class, syscall, intercept and host memory summary of the -s option
+void sim_print_summary(struct sim* sim, FILE* out);
+
+const char* sim_error_string(int error);
+
+// end the current basic block vector interval and write it to options->bbv_file.
+// sim_reset, sim_load and sim_destroy do it too
+void sim_flush_bbv(struct sim* sim);
+
+// the parts, for tools built on top
+struct hart* sim_hart(struct sim* sim);
+struct memory* sim_memory(struct sim* sim);
+struct predecode* sim_predecode(struct sim* sim);
+struct symbols* sim_symbols(struct sim* sim);            // NULL if the program has none
+const struct program_info* sim_program_info(struct sim* sim);
+struct syscalls* sim_syscalls(struct sim* sim);
+struct intercepts* sim_intercepts(struct sim* sim);      // NULL unless options->intercept
+struct profile* sim_profile(struct sim* sim);            // NULL unless options->profile; since load or reset
+
+#endif
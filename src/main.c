@@ -1,134 +1,534 @@
-#include "memory.h"
-#include "read_elf.h"
+#include "libsim.h"
 #include "disassemble.h"
-#include "simulate.h"
+#include "format.h"
+#include "server.h"
+#include "batch.h"
+#include "perf.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 void terminate(const char *error)
 {
   printf("%s\n", error);
   printf("RISC-V Simulator v0.11.0: Usage:\n");
   printf("  sim riscv-elf sim-options -- prog-args\n");
+  printf("  sim --server riscv-elf sim-options   // load once, run once per line of prog-args on stdin (see server.h)\n");
+  printf("  sim --batch manifest [-j threads] [--max-insns n] [--json]   // run the jobs in manifest in parallel,\n");
+  printf("                               // each for at most n instructions, default %ld (see batch.h)\n", BATCH_MAX_INSNS);
+  printf("  sim --restore checkpoint sim-options   // go on from a checkpoint file, without the riscv-elf\n");
   printf("    sim-options: options to the simulator\n");
   printf("      sim riscv-elf -d         // disassemble text segment of riscv-elf file to stdout\n");
   printf("      sim riscv-elf -l log     // simulate and log each instruction to file 'log'\n");
-  printf("      sim riscv-elf -s log     // simulate and log only summary to file 'log'\n");
+  printf("      sim riscv-elf -s log     // simulate and log only summary to file 'log', with host time per phase\n");
+  printf("      sim riscv-elf --json file   // write instructions, host time per phase and peak memory use to 'file'\n");
+  printf("      sim riscv-elf --mix      // print how often each instruction ran, most frequent first\n");
+  printf("      sim riscv-elf --perf     // count host cycles, branch and cache misses during the simulation (see perf.h)\n");
+  printf("      sim riscv-elf -p prof    // simulate and write the disassembly with execution counts to file 'prof'\n");
+  printf("      sim riscv-elf --bbv interval file   // write SimPoint basic block vectors, one per 'interval'\n");
+  printf("                               // instructions, to 'file' (see bbv.h)\n");
+  printf("      sim riscv-elf -u         // simulate with unbuffered console output (for interactive use)\n");
+  printf("      sim riscv-elf -i         // simulate with host versions of memcpy, strlen etc. (see intercept.h)\n");
+  printf("      sim riscv-elf --checkpoint-at symbol|count file   // write a checkpoint when the program reaches\n");
+  printf("                               // 'symbol' or has run 'count' instructions, then go on (see checkpoint.h)\n");
   printf("    prog-args: arguments to the simulated program\n");
   printf("               these arguments are provided through argv. Puts '--' in argv[0]\n");
   printf("      sim riscv-elf -- gylletank   // run riscv-elf with 'gylletank' in argv[1]\n");
+  printf("  The exit status is the simulated program's exit code, or -1 if it stopped on a fault\n");
   exit(-1);
 }
 
-// Helper function - grabs args to simulated program from command line and places them in simulated memory
-int pass_args_to_program(struct memory* mem, int argc, char* argv[]) {
+// Helper function - finds the args to the simulated program on the command line.
+// They start at the '--' seperator; returns its position (argc if there is none)
+int find_program_args(int argc, char* argv[]) {
   int seperator_position = 1; // skip first, it is the path to the simulator
-  int seperator_found = 0;
   while (seperator_position < argc) {
-    seperator_found = strcmp(argv[seperator_position],"--") == 0;
-    if (seperator_found) break;
+    if (strcmp(argv[seperator_position],"--") == 0) break;
     seperator_position++;
   }
-  if (seperator_found) { // we've got args for the program!!
-    // the seperator is the first arg.
-    int first_arg = seperator_position;
-    int num_args = argc - first_arg;
-    unsigned count_addr = 0x1000000;
-    unsigned argv_addr = 0x1000004;
-    unsigned str_addr = argv_addr + 4 * num_args;
-    memory_wr_w(mem, count_addr, num_args);
-    for (int index = 0; index < num_args; ++index) {
-      memory_wr_w(mem, argv_addr + 4 * index, str_addr);
-      char* cp = argv[first_arg + index];
-      int c;
-      do {
-        c = *cp++;
-        memory_wr_b(mem, str_addr++, c);
-      } while (c);
-    }
-  }
   // leave it to main to handle args before the seperator
   return seperator_position;
 }
 
+// Helper function, formats one line of disassembly
+static void disassemble_line(struct fmt_buf* out, struct predecode* pd, unsigned int addr, struct symbols* symbols)
+{
+  uint32_t index = (addr - pd->text_start) / 4;
+  struct insn insn;
+  predecode_get(pd, index, &insn);
+  // intercepts and breakpoints replace the id, the word is still the original
+  if (insn.id >= NUM_INSNS)
+    decode(pd->word[index], &insn);
+  fmt_hex(out, addr, 8, ' ', 0);
+  fmt_mem(out, " : ", 3);
+  fmt_hex(out, pd->word[index], 8, '0', 1);
+  fmt_mem(out, "       ", 7);
+  disassemble_insn_fmt(addr, pd->word[index], &insn, out, symbols);
+  fmt_char(out, '\n');
+}
+
+// Parallel disassembly: the text segment is cut into chunks which worker threads
+// format into private buffers. The main thread writes the chunks in address order,
+// so the output is identical to the serial version.
+#define DISASM_CHUNK_INSNS 16384
+#define DISASM_LINE_MAX 64
+
+struct disasm_job {
+  struct predecode* pd;
+  struct symbols* symbols;
+  unsigned int text_start;
+  unsigned int text_end;
+  int num_chunks;
+  int next_chunk;
+  char** chunk_data;
+  size_t* chunk_len;
+  int* chunk_done;
+  pthread_mutex_t lock;
+  pthread_cond_t chunk_ready;
+};
+
+static void chunk_range(const struct disasm_job* job, int chunk, unsigned int* start, unsigned int* end)
+{
+  *start = job->text_start + 4u * DISASM_CHUNK_INSNS * chunk;
+  *end = *start + 4u * DISASM_CHUNK_INSNS;
+  if (*end > job->text_end || *end < *start) *end = job->text_end;
+}
+
+static void* disasm_worker(void* arg)
+{
+  struct disasm_job* job = arg;
+  for (;;) {
+    int chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk >= job->num_chunks) break;
+    unsigned int start, end;
+    chunk_range(job, chunk, &start, &end);
+    size_t cap = (size_t)(end - start + 3) / 4 * DISASM_LINE_MAX + 1;
+    char* data = malloc(cap);
+    size_t len = 0;
+    if (data) {
+      // a chunk without a buffer is left to the main thread
+      struct fmt_buf out;
+      fmt_init(&out, data, cap, -1);
+      for (unsigned int addr = start; addr < end; addr += 4)
+        disassemble_line(&out, job->pd, addr, job->symbols);
+      len = out.len;
+    }
+    pthread_mutex_lock(&job->lock);
+    job->chunk_data[chunk] = data;
+    job->chunk_len[chunk] = len;
+    job->chunk_done[chunk] = 1;
+    pthread_cond_broadcast(&job->chunk_ready);
+    pthread_mutex_unlock(&job->lock);
+  }
+  return NULL;
+}
+
+static void write_all(int fd, const char* data, size_t len)
+{
+  struct fmt_buf out;
+  fmt_init(&out, NULL, 0, fd);
+  fmt_mem(&out, data, len);
+}
+
+// formats a chunk straight to stdout, through a small buffer
+static void write_chunk(struct disasm_job* job, int chunk)
+{
+  char buf[4096];
+  struct fmt_buf out;
+  unsigned int start, end;
+  chunk_range(job, chunk, &start, &end);
+  fmt_init(&out, buf, sizeof(buf), STDOUT_FILENO);
+  for (unsigned int addr = start; addr < end; addr += 4)
+    disassemble_line(&out, job->pd, addr, job->symbols);
+  fmt_flush(&out);
+}
+
+// returns 0 if the work could not be handed out to threads
+static int disassemble_parallel(struct predecode* pd, struct program_info* prog_info, struct symbols* symbols, int num_threads)
+{
+  struct disasm_job job;
+  unsigned int num_insns = (prog_info->text_end - prog_info->text_start + 3) / 4;
+  job.pd = pd;
+  job.symbols = symbols;
+  job.text_start = prog_info->text_start;
+  job.text_end = prog_info->text_end;
+  job.num_chunks = (num_insns + DISASM_CHUNK_INSNS - 1) / DISASM_CHUNK_INSNS;
+  job.next_chunk = 0;
+  job.chunk_data = calloc(job.num_chunks, sizeof(char*));
+  job.chunk_len = calloc(job.num_chunks, sizeof(size_t));
+  job.chunk_done = calloc(job.num_chunks, sizeof(int));
+  if (!job.chunk_data || !job.chunk_len || !job.chunk_done) {
+    free(job.chunk_data);
+    free(job.chunk_len);
+    free(job.chunk_done);
+    return 0;
+  }
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.chunk_ready, NULL);
+
+  if (num_threads > job.num_chunks) num_threads = job.num_chunks;
+  pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+  int started = 0;
+  while (threads && started < num_threads && pthread_create(&threads[started], NULL, disasm_worker, &job) == 0)
+    started++;
+  if (started == 0) {
+    // no threads - do the work here instead
+    disasm_worker(&job);
+  }
+
+  for (int chunk = 0; chunk < job.num_chunks; chunk++) {
+    pthread_mutex_lock(&job.lock);
+    while (!job.chunk_done[chunk])
+      pthread_cond_wait(&job.chunk_ready, &job.lock);
+    pthread_mutex_unlock(&job.lock);
+    if (job.chunk_data[chunk])
+      write_all(STDOUT_FILENO, job.chunk_data[chunk], job.chunk_len[chunk]);
+    else
+      write_chunk(&job, chunk);
+    free(job.chunk_data[chunk]);
+  }
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+  pthread_cond_destroy(&job.chunk_ready);
+  pthread_mutex_destroy(&job.lock);
+  free(job.chunk_data);
+  free(job.chunk_len);
+  free(job.chunk_done);
+  return 1;
+}
+
 // Helper function, prints disassembly
-void disassemble_to_stdout(struct memory* mem, struct program_info* prog_info, struct symbols* symbols) 
+void disassemble_to_stdout(struct predecode* pd, struct program_info* prog_info, struct symbols* symbols) 
 {
-  const int buf_size = 100;
-  char disassembly[buf_size];
-  for (unsigned int addr = prog_info->text_start; addr < prog_info->text_end; addr += 4) {
-    unsigned int instruction = memory_rd_w(mem, addr);
-    disassemble(addr, instruction, disassembly, buf_size, symbols);
-    printf("%8x : %08X       %s\n", addr, instruction, disassembly);
+  unsigned int num_insns = (prog_info->text_end - prog_info->text_start) / 4;
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cpus > 1 && num_insns > 2 * DISASM_CHUNK_INSNS) {
+    if (disassemble_parallel(pd, prog_info, symbols, num_cpus))
+      return;
   }
+  // format into one large buffer and hand it to write() a chunk at a time
+  const int buf_size = 1 << 16;
+  static char output[1 << 16];
+  struct fmt_buf out;
+  fmt_init(&out, output, buf_size, STDOUT_FILENO);
+  for (unsigned int addr = prog_info->text_start; addr < prog_info->text_end; addr += 4)
+    disassemble_line(&out, pd, addr, symbols);
+  fmt_flush(&out);
+}
+
+static double wall_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Host time per phase of a run, for the -s summary and --json
+struct host_times {
+  double startup;         // main up to sim_load: options, sim_create
+  struct sim_times sim;   // sim_load and sim_run
+  double destroy;         // sim_destroy, mostly memory_delete
+  double total;
+  double user, system;    // process CPU time
+  long peak_rss;          // KiB
+};
+
+#define NUM_PHASES 9
+
+static void get_phases(const struct host_times *times, const char *names[], double values[])
+{
+  const char *phase_names[NUM_PHASES] = { "startup", "memory_create", "read_elf", "symbols", "predecode", "args", "snapshot", "simulate", "memory_delete" };
+  double phase_values[NUM_PHASES] = { times->startup, times->sim.memory_create, times->sim.read_elf, times->sim.symbols, times->sim.predecode,
+                                      times->sim.args, times->sim.snapshot, times->sim.run, times->destroy };
+  memcpy(names, phase_names, sizeof(phase_names));
+  memcpy(values, phase_values, sizeof(phase_values));
+}
+
+static void print_host_times(FILE *out, const struct host_times *times)
+{
+  const char *names[NUM_PHASES];
+  double values[NUM_PHASES];
+  get_phases(times, names, values);
+  fprintf(out, "\nHost time per phase (wall clock):\n");
+  for (int i = 0; i < NUM_PHASES; i++)
+    fprintf(out, "  %-14s %12.6f s\n", names[i], values[i]);
+  fprintf(out, "  %-14s %12.6f s\n", "total", times->total);
+  fprintf(out, "Simulation CPU time %.6f s of %.6f s wall; process CPU time user %.6f s, system %.6f s\n",
+          times->sim.run_cpu, times->sim.run, times->user, times->system);
+  fprintf(out, "Peak resident set size: %ld KiB\n", times->peak_rss);
+}
+
+// perf may be NULL
+static void write_json(FILE *out, const struct Stat *stats, const struct host_times *times, const struct perf_counters *perf)
+{
+  const char *names[NUM_PHASES];
+  double values[NUM_PHASES];
+  get_phases(times, names, values);
+  fprintf(out, "{\n  \"insns\": %ld,\n  \"mips\": %.2f,\n  \"fault\": %d,\n  \"phases_s\": {",
+          stats->insns, times->sim.run > 0 ? stats->insns / times->sim.run / 1e6 : 0.0, stats->fault);
+  for (int i = 0; i < NUM_PHASES; i++)
+    fprintf(out, "%s\n    \"%s\": %.9f", i ? "," : "", names[i], values[i]);
+  fprintf(out, "\n  },\n  \"total_s\": %.9f,\n  \"simulate_cpu_s\": %.9f,\n  \"user_s\": %.6f,\n  \"system_s\": %.6f,\n  \"peak_rss_kib\": %ld",
+          times->total, times->sim.run_cpu, times->user, times->system, times->peak_rss);
+  if (perf)
+  {
+    // the counters the host has
+    fprintf(out, ",\n  \"guest_branches\": %ld,\n  \"host_counters\": {", stats->branches_taken + stats->branches_not_taken);
+    const char *separator = "";
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+      if (perf_counter_available(perf, i))
+      {
+        fprintf(out, "%s\n    \"%s\": %llu", separator, perf_counter_name(i), (unsigned long long)perf->value[i]);
+        separator = ",";
+      }
+    fprintf(out, "\n  }");
+  }
+  fprintf(out, "\n}\n");
 }
 
 int main(int argc, char *argv[])
 {
-  struct memory *mem = memory_create();
-  argc = pass_args_to_program(mem, argc, argv);
-  if (argc == 2 || argc == 3 || argc == 4)
+  struct host_times times;
+  memset(&times, 0, sizeof(times));
+  double start = wall_clock();
+  if (argc > 2 && !strcmp(argv[1], "--batch"))
   {
-    FILE *log_file = NULL;
-    FILE *prof_file = NULL;
-    if (argc == 4 && !strcmp(argv[2], "-l"))
+    int num_threads = 0;
+    int json = 0;
+    long max_insns = BATCH_MAX_INSNS;
+    for (int i = 3; i < argc; i++)
     {
-      log_file = fopen(argv[3], "w");
-      if (log_file == NULL)
+      if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        num_threads = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--max-insns") && i + 1 < argc)
+        max_insns = strtol(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "--json"))
+        json = 1;
+      else
+        terminate("Unknown or incomplete option");
+    }
+    return batch_run(argv[2], num_threads, max_insns, json, stdout);
+  }
+  int seperator_position = find_program_args(argc, argv);
+  int num_prog_args = argc - seperator_position;
+  char **prog_args = argv + seperator_position;
+  argc = seperator_position;
+  int server = argc > 1 && !strcmp(argv[1], "--server");
+  int restore = argc > 1 && !strcmp(argv[1], "--restore");
+  if (server || restore)
+  {
+    argv++;
+    argc--;
+  }
+  if (argc < 2)
+  {
+    terminate("Missing operands");
+  }
+  struct sim_options options;
+  sim_default_options(&options);
+  FILE *prof_file = NULL;
+  const char *summary_file_name = NULL;
+  const char *checkpoint_at = NULL;
+  const char *checkpoint_file = NULL;
+  const char *json_file_name = NULL;
+  int disassemble_only = 0;
+  int use_perf = 0;
+  int print_mix = 0;
+  for (int i = 2; i < argc; i++)
+  {
+    const char *option = argv[i];
+    int has_value = i + 1 < argc;
+    if (!strcmp(option, "-d"))
+    {
+      disassemble_only = 1;
+    }
+    else if (!strcmp(option, "-l") && has_value)
+    {
+      options.log_file = fopen(argv[++i], "w");
+      if (options.log_file == NULL)
       {
         terminate("Could not open logfile, terminating.");
       }
     }
-    if (argc == 4 && !strcmp(argv[2], "-p"))
+    else if (!strcmp(option, "-s") && has_value)
+    {
+      summary_file_name = argv[++i];
+      // system calls are only timed and instructions counted when the summary will show it
+      options.timed_syscalls = 1;
+      options.stats = 1;
+    }
+    else if (!strcmp(option, "--json") && has_value)
+    {
+      json_file_name = argv[++i];
+    }
+    else if (!strcmp(option, "-p") && has_value)
     {
-      prof_file = fopen(argv[3], "w");
+      prof_file = fopen(argv[++i], "w");
       if (prof_file == NULL)
       {
         terminate("Could not open file for exec profile, terminating.");
       }
+      options.profile = 1;
     }
-    struct program_info prog_info;
-    int status = read_elf(mem, &prog_info, argv[1], log_file);
-    if (status) exit(status);
-    struct symbols* symbols = symbols_read_from_elf(argv[1]);
-    if (symbols == NULL) {
-      exit(-1);
-    }
-    if (argc == 3 && !strcmp(argv[2], "-d")) {
-      // disassemble text segment to stdout
-      disassemble_to_stdout(mem, &prog_info, symbols);
-      exit(0);
-    }
-    int start_addr = prog_info.start;
-    clock_t before = clock();
-    struct Stat stats = simulate(mem, start_addr, log_file, symbols);
-    long int num_insns = stats.insns;
-    clock_t after = clock();
-    int ticks = after - before;
-    double mips = (1.0 * num_insns * CLOCKS_PER_SEC) / ticks / 1000000;
-    if (argc == 4 && !strcmp(argv[2], "-s"))
-    {
-      log_file = fopen(argv[3], "w");
-      if (log_file == NULL)
+    else if (!strcmp(option, "--bbv") && i + 2 < argc)
+    {
+      options.bbv_interval = strtol(argv[++i], NULL, 0);
+      if (options.bbv_interval <= 0)
       {
-        terminate("Could not open logfile, terminating.");
+        terminate("The --bbv interval must be a positive number of instructions");
+      }
+      options.bbv_file = fopen(argv[++i], "w");
+      if (options.bbv_file == NULL)
+      {
+        terminate("Could not open file for basic block vectors, terminating.");
       }
     }
-    if (log_file)
+    else if (!strcmp(option, "--mix"))
+    {
+      print_mix = 1;
+      options.stats = 1;
+    }
+    else if (!strcmp(option, "--perf"))
+    {
+      // the counters measure whichever loop the other options select: the
+      // plain one with only a branch counter, for the misses per guest branch,
+      // unless -s, --mix, -p, --bbv or -l ask for more
+      use_perf = 1;
+      options.count_branches = 1;
+    }
+    else if (!strcmp(option, "-u"))
+    {
+      options.console_mode = CONSOLE_UNBUFFERED;
+    }
+    else if (!strcmp(option, "-i"))
+    {
+      options.intercept = 1;
+    }
+    else if (!strcmp(option, "--checkpoint-at") && i + 2 < argc)
     {
-      fprintf(log_file, "\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns, ticks, mips);
-      fclose(log_file);
+      checkpoint_at = argv[++i];
+      checkpoint_file = argv[++i];
     }
     else
     {
-      printf("\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns, ticks, mips);
+      terminate("Unknown or incomplete option");
     }
-    memory_delete(mem);
   }
-  else {
-    terminate("Missing operands");
-    memory_delete(mem);
+  struct sim *sim = sim_create(&options);
+  if (sim == NULL)
+  {
+    terminate("Out of memory, terminating.");
+  }
+  times.startup = wall_clock() - start;
+  int status = restore ? sim_restore(sim, argv[1]) : sim_load(sim, argv[1], num_prog_args, prog_args);
+  if (status != SIM_OK)
+  {
+    fprintf(stderr, "%s: %s\n", argv[1], sim_error_string(status));
+    exit(-1);
+  }
+  if (disassemble_only) {
+    // disassemble text segment to stdout
+    struct program_info prog_info = *sim_program_info(sim);
+    disassemble_to_stdout(sim_predecode(sim), &prog_info, sim_symbols(sim));
+    exit(0);
+  }
+  if (server)
+  {
+    struct program_info prog_info = *sim_program_info(sim);
+    struct server_program program = { sim_memory(sim), &prog_info, sim_symbols(sim), sim_predecode(sim), sim_intercepts(sim) };
+    server_run(&program, stdin, STDOUT_FILENO);
+    sim_destroy(sim);
+    exit(0);
+  }
+  struct perf_counters perf;
+  if (use_perf)
+  {
+    if (perf_counters_open(&perf) == 0)
+      fprintf(stderr, "Host performance counters are not available\n");
+    perf_counters_start(&perf);
+  }
+  if (checkpoint_file)
+  {
+    // a number of instructions, or else a symbol to stop at
+    char *end;
+    long int count = strtol(checkpoint_at, &end, 0);
+    unsigned int addr;
+    if (*end == 0)
+      status = sim_run(sim, count);
+    else if (sim_symbols(sim) && symbols_sym_to_value(sim_symbols(sim), checkpoint_at, &addr))
+      status = sim_run_until(sim, addr, -1);
+    else
+      terminate("Unknown symbol for --checkpoint-at");
+    if (status == SIM_STOPPED)
+    {
+      if (use_perf) perf_counters_stop(&perf);
+      status = sim_save_checkpoint(sim, checkpoint_file);
+      if (use_perf) perf_counters_start(&perf);
+    }
+    else
+      fprintf(stderr, "%s: the program ended before the checkpoint\n", checkpoint_file);
+    if (status < 0)
+      fprintf(stderr, "%s: %s\n", checkpoint_file, sim_error_string(status));
+  }
+  sim_run(sim, -1);
+  if (use_perf) perf_counters_stop(&perf);
+  struct Stat stats = *sim_stats(sim);
+  times.sim = *sim_times(sim);
+  long int num_insns = stats.insns;
+  double mips = times.sim.run > 0 ? num_insns / times.sim.run / 1e6 : 0;
+  simulate_print_fault(stderr, &stats);
+  FILE *log_file = options.log_file;
+  if (summary_file_name)
+  {
+    if (log_file) fclose(log_file);
+    log_file = fopen(summary_file_name, "w");
+    if (log_file == NULL)
+    {
+      terminate("Could not open logfile, terminating.");
+    }
+  }
+  FILE *out = log_file ? log_file : stdout;
+  fprintf(out, "\nSimulated %ld instructions in %.6f s (%f MIPS)\n", num_insns, times.sim.run, mips);
+  if (stats.intercepted)
+    fprintf(out, "Ran %ld calls as host functions, about %ld guest instructions\n", stats.intercepted, stats.intercepted_insns);
+  if (print_mix) simulate_print_mix(out, &stats);
+  if (use_perf) perf_counters_print(&perf, num_insns, stats.branches_taken + stats.branches_not_taken, out);
+  if (summary_file_name) sim_print_summary(sim, out);
+  if (prof_file)
+  {
+    profile_print(sim_profile(sim), sim_predecode(sim), sim_symbols(sim), prof_file);
+    fclose(prof_file);
+  }
+  double before_destroy = wall_clock();
+  sim_destroy(sim);
+  times.destroy = wall_clock() - before_destroy;
+  // sim_destroy wrote the last vector
+  if (options.bbv_file) fclose(options.bbv_file);
+  times.total = wall_clock() - start;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  times.user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6;
+  times.system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+  times.peak_rss = usage.ru_maxrss;
+  if (summary_file_name) print_host_times(out, &times);
+  if (log_file) fclose(log_file);
+  if (json_file_name)
+  {
+    FILE *json_file = fopen(json_file_name, "w");
+    if (json_file == NULL)
+    {
+      fprintf(stderr, "%s: could not write the timings\n", json_file_name);
+      return -1;
+    }
+    write_json(json_file, &stats, &times, use_perf ? &perf : NULL);
+    fclose(json_file);
   }
+  if (use_perf) perf_counters_close(&perf);
+  return stats.fault ? -1 : stats.exit_code;
 }
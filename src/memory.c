@@ -1,66 +1,202 @@
 #include "memory.h"
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// page_flags
+#define PAGE_SHARED 1      // the page belongs to the snapshot; copy it before writing
+#define PAGE_DIRTY 2       // changed since the snapshot, on the dirty list
+
+// The snapshot owns the pages that were in use when it was taken. Memory
+// shares them until a page is written (or released); then the page gets a
+// private copy and goes on the dirty list. Restoring puts the snapshot's
+// pages back for the pages on the dirty list only.
+struct snapshot
+{
+  int *pages[0x10000];
+  int pages_in_use;
+  unsigned state_size;
+  unsigned char *state;
+};
 
 struct memory
 {
   int *pages[0x10000];
+  int pages_in_use;
+  int copies;        // snapshot pages memory no longer shares (written or released since)
+  int peak_pages;    // of pages_in_use + copies, the pages the host holds
+  int error;         // the first error since memory_clear_error
+  int error_addr;
+  struct snapshot *snapshot;   // NULL until memory_snapshot
+  unsigned char *mapping;      // pages mapped from a file, see memory_map_pages
+  size_t mapping_size;
+  int num_dirty;
+  unsigned short dirty[0x10000];
+  unsigned char page_flags[0x10000];
+  int num_touched;             // see memory_pages_touched
+  unsigned char touched[0x10000];
 };
 
+// Pages are allocated on the first write. Reads from a page that has never
+// been written see this page of zeroes instead.
+static const int zero_page[0x4000];
+
+// pages inside the mapping are not ours to free
+static void free_page(struct memory *mem, int *page)
+{
+  unsigned char *p = (unsigned char *)page;
+  if (mem->mapping == NULL || p < mem->mapping || p >= mem->mapping + mem->mapping_size)
+    free(page);
+}
+
 struct memory *memory_create()
 {
   return calloc(sizeof(struct memory), 1);
 }
 
-void memory_delete(struct memory *mem)
+// the pages the host holds; a copy-on-write copy is a page more
+static void update_peak(struct memory *mem)
+{
+  if (mem->pages_in_use + mem->copies > mem->peak_pages)
+    mem->peak_pages = mem->pages_in_use + mem->copies;
+}
+
+static void free_all(struct memory *mem)
 {
   for (int j = 0; j < 0x10000; ++j)
   {
-    if (mem->pages[j])
-      free(mem->pages[j]);
+    if (mem->pages[j] && !(mem->page_flags[j] & PAGE_SHARED))
+      free_page(mem, mem->pages[j]);
+  }
+  if (mem->snapshot)
+  {
+    for (int j = 0; j < 0x10000; ++j)
+      free_page(mem, mem->snapshot->pages[j]);
+    free(mem->snapshot->state);
+    free(mem->snapshot);
   }
+  if (mem->mapping)
+    munmap(mem->mapping, mem->mapping_size);
+}
+
+void memory_delete(struct memory *mem)
+{
+  free_all(mem);
   free(mem);
 }
 
-int *get_page(struct memory *mem, int addr)
+void memory_clear(struct memory *mem)
+{
+  free_all(mem);
+  memset(mem, 0, sizeof(struct memory));
+}
+
+static int set_error(struct memory *mem, int error, int addr)
+{
+  if (mem->error == MEMORY_OK)
+  {
+    mem->error = error;
+    mem->error_addr = addr;
+  }
+  return error;
+}
+
+int memory_error(struct memory *mem, int *addr)
+{
+  if (addr)
+    *addr = mem->error_addr;
+  return mem->error;
+}
+
+void memory_clear_error(struct memory *mem)
+{
+  mem->error = MEMORY_OK;
+  mem->error_addr = 0;
+}
+
+// a page is about to differ from the snapshot
+static void mark_dirty(struct memory *mem, int page_number)
+{
+  if (mem->snapshot && !(mem->page_flags[page_number] & PAGE_DIRTY))
+  {
+    mem->page_flags[page_number] |= PAGE_DIRTY;
+    mem->dirty[mem->num_dirty++] = page_number;
+  }
+}
+
+// allocate a page, or a private copy of a page shared with the snapshot
+static int *new_page(struct memory *mem, int addr)
 {
   int page_number = (addr >> 16) & 0x0ffff;
-  if (mem->pages[page_number] == NULL)
+  int *shared = mem->pages[page_number];
+  int *page = shared ? malloc(65536) : calloc(65536, 1);
+  if (page == NULL)
   {
-    mem->pages[page_number] = calloc(65536, 1);
+    set_error(mem, MEMORY_OUT_OF_MEMORY, addr);
+    return NULL;
   }
+  if (shared)
+  {
+    memcpy(page, shared, 65536);
+    mem->page_flags[page_number] &= ~PAGE_SHARED;
+    mem->copies++;
+  }
+  else
+  {
+    mem->pages_in_use++;
+  }
+  update_peak(mem);
+  mark_dirty(mem, page_number);
+  mem->pages[page_number] = page;
+  return page;
+}
+
+// the page holding addr, allocated if needed; NULL if the host is out of memory
+static int *get_page(struct memory *mem, int addr)
+{
+  int page_number = (addr >> 16) & 0x0ffff;
+  if (mem->pages[page_number] == NULL || (mem->page_flags[page_number] & PAGE_SHARED))
+    return new_page(mem, addr);
   return mem->pages[page_number];
 }
 
-void memory_wr_w(struct memory *mem, int addr, int data)
+static const int *get_page_rd(struct memory *mem, int addr)
+{
+  const int *page = mem->pages[(addr >> 16) & 0x0ffff];
+  return page ? page : zero_page;
+}
+
+int memory_wr_w(struct memory *mem, int addr, int data)
 {
   if (addr & 0x3)
-  {
-    printf("Unaligned word write to %x\n", addr);
-    exit(-1);
-  }
+    return set_error(mem, MEMORY_UNALIGNED, addr);
   int *page = get_page(mem, addr);
+  if (page == NULL)
+    return MEMORY_OUT_OF_MEMORY;
   page[(addr >> 2) & 0x3fff] = data;
+  return MEMORY_OK;
 }
 
-void memory_wr_h(struct memory *mem, int addr, int data)
+int memory_wr_h(struct memory *mem, int addr, int data)
 {
   if (addr & 0x1)
-  {
-    printf("Unaligned halfword write to %x\n", addr);
-    exit(-1);
-  }
+    return set_error(mem, MEMORY_UNALIGNED, addr);
   int *page = get_page(mem, addr);
+  if (page == NULL)
+    return MEMORY_OUT_OF_MEMORY;
   int index = (addr >> 2) & 0x3fff;
   if ((addr & 2) == 0)
     page[index] = (page[index] & 0xffff0000) | (data & 0x0000ffff);
   else
     page[index] = (page[index] & 0x0000ffff) | ((unsigned)data << 16);
+  return MEMORY_OK;
 }
 
-void memory_wr_b(struct memory *mem, int addr, int data)
+int memory_wr_b(struct memory *mem, int addr, int data)
 {
   int *page = get_page(mem, addr);
+  if (page == NULL)
+    return MEMORY_OUT_OF_MEMORY;
   int index = (addr >> 2) & 0x3fff;
   switch (addr & 0x3)
   {
@@ -77,27 +213,28 @@ void memory_wr_b(struct memory *mem, int addr, int data)
     page[index] = (page[index] & 0x00ffffff) | (((unsigned)(data & 0xff)) << 24);
     break;
   }
+  return MEMORY_OK;
 }
 
 int memory_rd_w(struct memory *mem, int addr)
 {
-  int *page = get_page(mem, addr);
+  const int *page = get_page_rd(mem, addr);
   if (addr & 0x3)
   {
-    printf("Unaligned word read from %x\n", addr);
-    exit(-1);
+    set_error(mem, MEMORY_UNALIGNED, addr);
+    return 0;
   }
   return page[(addr >> 2) & 0x3fff];
 }
 
 int memory_rd_h(struct memory *mem, int addr)
 {
-  int *page = get_page(mem, addr);
+  const int *page = get_page_rd(mem, addr);
   int index = (addr >> 2) & 0x3fff;
   if (addr & 0x1)
   {
-    printf("Unaligned halfword read from %x\n", addr);
-    exit(-1);
+    set_error(mem, MEMORY_UNALIGNED, addr);
+    return 0;
   }
   if ((addr & 2) == 0)
     return page[index] & 0xffff;
@@ -107,7 +244,7 @@ int memory_rd_h(struct memory *mem, int addr)
 
 int memory_rd_b(struct memory *mem, int addr)
 {
-  int *page = get_page(mem, addr);
+  const int *page = get_page_rd(mem, addr);
   int index = (addr >> 2) & 0x3fff;
   switch (addr & 0x3)
   {
@@ -126,3 +263,257 @@ int memory_rd_b(struct memory *mem, int addr)
   }
   return 0; // silence a warning
 }
+
+// Bytes are packed little endian into the words of a page, so on a little
+// endian host a page is the byte image of guest memory and blocks can be
+// copied with memcpy, one page at a time.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BLOCK_COPY_MEMCPY 1
+#else
+#define BLOCK_COPY_MEMCPY 0
+#endif
+
+void memory_rd_block(struct memory *mem, int addr, void *dst, unsigned size)
+{
+  unsigned char *to = dst;
+  while (size > 0)
+  {
+    unsigned offset = addr & 0xffff;
+    unsigned chunk = 0x10000 - offset;
+    if (chunk > size)
+      chunk = size;
+    memory_touch(mem, addr);
+    if (BLOCK_COPY_MEMCPY)
+    {
+      memcpy(to, (const unsigned char *)get_page_rd(mem, addr) + offset, chunk);
+    }
+    else
+    {
+      for (unsigned j = 0; j < chunk; j++)
+        to[j] = memory_rd_b(mem, addr + j);
+    }
+    to += chunk;
+    addr = (unsigned)addr + chunk;
+    size -= chunk;
+  }
+}
+
+int memory_wr_block(struct memory *mem, int addr, const void *src, unsigned size)
+{
+  const unsigned char *from = src;
+  while (size > 0)
+  {
+    unsigned offset = addr & 0xffff;
+    unsigned chunk = 0x10000 - offset;
+    if (chunk > size)
+      chunk = size;
+    memory_touch(mem, addr);
+    if (BLOCK_COPY_MEMCPY)
+    {
+      unsigned char *page = (unsigned char *)get_page(mem, addr);
+      if (page == NULL)
+        return MEMORY_OUT_OF_MEMORY;
+      memcpy(page + offset, from, chunk);
+    }
+    else
+    {
+      for (unsigned j = 0; j < chunk; j++)
+        if (memory_wr_b(mem, addr + j, from[j]) != MEMORY_OK)
+          return MEMORY_OUT_OF_MEMORY;
+    }
+    from += chunk;
+    addr = (unsigned)addr + chunk;
+    size -= chunk;
+  }
+  return MEMORY_OK;
+}
+
+int memory_set_block(struct memory *mem, int addr, int value, unsigned size)
+{
+  while (size > 0)
+  {
+    unsigned offset = addr & 0xffff;
+    unsigned chunk = 0x10000 - offset;
+    if (chunk > size)
+      chunk = size;
+    memory_touch(mem, addr);
+    // the same byte in every position, so the byte order does not matter.
+    // Zeroing a page that was never written leaves it unallocated
+    if ((value & 0xff) || mem->pages[(addr >> 16) & 0x0ffff])
+    {
+      unsigned char *page = (unsigned char *)get_page(mem, addr);
+      if (page == NULL)
+        return MEMORY_OUT_OF_MEMORY;
+      memset(page + offset, value, chunk);
+    }
+    addr = (unsigned)addr + chunk;
+    size -= chunk;
+  }
+  return MEMORY_OK;
+}
+
+void memory_release(struct memory *mem, int addr, unsigned size)
+{
+  while (size > 0)
+  {
+    unsigned offset = addr & 0xffff;
+    unsigned chunk = 0x10000 - offset;
+    if (chunk > size)
+      chunk = size;
+    int page_number = (addr >> 16) & 0x0ffff;
+    int *page = mem->pages[page_number];
+    if (page && chunk == 0x10000)
+    {
+      mark_dirty(mem, page_number);
+      if (mem->page_flags[page_number] & PAGE_SHARED)
+      {
+        // the snapshot keeps it
+        mem->page_flags[page_number] &= ~PAGE_SHARED;
+        mem->copies++;
+      }
+      else
+        free_page(mem, page);
+      mem->pages[page_number] = NULL;
+      mem->pages_in_use--;
+    }
+    else if (page)
+    {
+      page = get_page(mem, addr);
+      if (page)
+        memset((unsigned char *)page + offset, 0, chunk);
+    }
+    addr = (unsigned)addr + chunk;
+    size -= chunk;
+  }
+}
+
+int memory_pages_in_use(struct memory *mem)
+{
+  return mem->pages_in_use + mem->copies;
+}
+
+int memory_peak_pages(struct memory *mem)
+{
+  return mem->peak_pages;
+}
+
+void memory_touch(struct memory *mem, int addr)
+{
+#if SIM_STATS
+  int page_number = (addr >> 16) & 0x0ffff;
+  if (!mem->touched[page_number])
+  {
+    mem->touched[page_number] = 1;
+    mem->num_touched++;
+  }
+#else
+  (void)mem;
+  (void)addr;
+#endif
+}
+
+int memory_pages_touched(struct memory *mem)
+{
+  return mem->num_touched;
+}
+
+void memory_clear_touched(struct memory *mem)
+{
+  memset(mem->touched, 0, sizeof(mem->touched));
+  mem->num_touched = 0;
+}
+
+int memory_snapshot(struct memory *mem, const void *state, unsigned state_size)
+{
+  struct snapshot *snap = mem->snapshot;
+  unsigned char *saved_state = malloc(state_size ? state_size : 1);
+  if (saved_state == NULL)
+    return MEMORY_OUT_OF_MEMORY;
+  if (snap == NULL)
+  {
+    snap = calloc(sizeof(struct snapshot), 1);
+    if (snap == NULL)
+    {
+      free(saved_state);
+      return MEMORY_OUT_OF_MEMORY;
+    }
+    // everything in use is shared from now on
+    for (int j = 0; j < 0x10000; ++j)
+    {
+      snap->pages[j] = mem->pages[j];
+      if (mem->pages[j])
+        mem->page_flags[j] = PAGE_SHARED;
+    }
+    mem->snapshot = snap;
+  }
+  else
+  {
+    // only the dirty pages differ from the previous snapshot
+    for (int i = 0; i < mem->num_dirty; ++i)
+    {
+      int j = mem->dirty[i];
+      free_page(mem, snap->pages[j]);
+      snap->pages[j] = mem->pages[j];
+      mem->page_flags[j] = mem->pages[j] ? PAGE_SHARED : 0;
+    }
+  }
+  mem->num_dirty = 0;
+  mem->copies = 0;
+  snap->pages_in_use = mem->pages_in_use;
+  free(snap->state);
+  memcpy(saved_state, state, state_size);
+  snap->state = saved_state;
+  snap->state_size = state_size;
+  return MEMORY_OK;
+}
+
+int memory_restore(struct memory *mem, void *state)
+{
+  struct snapshot *snap = mem->snapshot;
+  if (snap == NULL)
+    return -1;
+  int restored = mem->num_dirty;
+  for (int i = 0; i < mem->num_dirty; ++i)
+  {
+    int j = mem->dirty[i];
+    if (mem->pages[j] && !(mem->page_flags[j] & PAGE_SHARED))
+      free_page(mem, mem->pages[j]);
+    mem->pages[j] = snap->pages[j];
+    mem->page_flags[j] = snap->pages[j] ? PAGE_SHARED : 0;
+  }
+  mem->num_dirty = 0;
+  mem->copies = 0;
+  mem->pages_in_use = snap->pages_in_use;
+  memcpy(state, snap->state, snap->state_size);
+  return restored;
+}
+
+int memory_page_dirty(struct memory *mem, int addr)
+{
+  return mem->snapshot && (mem->page_flags[(addr >> 16) & 0x0ffff] & PAGE_DIRTY);
+}
+
+const void *memory_page_data(struct memory *mem, int page_number)
+{
+  return mem->pages[page_number & 0x0ffff];
+}
+
+int memory_map_pages(struct memory *mem, void *mapping, size_t size, size_t offset,
+                     const unsigned *page_numbers, int num_pages)
+{
+  if (mem->mapping || offset + (size_t)num_pages * MEMORY_PAGE_SIZE > size)
+    return -1;
+  mem->mapping = mapping;
+  mem->mapping_size = size;
+  for (int i = 0; i < num_pages; ++i)
+  {
+    int page_number = page_numbers[i] & 0x0ffff;
+    if (mem->pages[page_number])
+      continue;
+    mark_dirty(mem, page_number);
+    mem->pages[page_number] = (int *)(mem->mapping + offset + (size_t)i * MEMORY_PAGE_SIZE);
+    mem->pages_in_use++;
+    update_peak(mem);
+  }
+  return MEMORY_OK;
+}
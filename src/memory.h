@@ -1,19 +1,83 @@
 #ifndef __MEMORY_H__
 #define __MEMORY_H__
 
+#include <stddef.h>
+
+// SIM_STATS=0 (make sim-fast) fjerner tællingen af berørte sider her og den
+// udvidede statistik i simulate.h
+#ifndef SIM_STATS
+#define SIM_STATS 1
+#endif
+
 struct memory;
 
 // opret/nedlæg lager
 struct memory *memory_create();
 void memory_delete(struct memory *);
 
+// som nyt fra memory_create: alle sider, øjebliksbilledet og mappingen frigives
+void memory_clear(struct memory *mem);
+
+// fejl stopper ikke programmet: skrivning returnerer fejlkoden, og lageret
+// husker den første fejl (og adressen) til den hentes med memory_error
+#define MEMORY_OK 0
+#define MEMORY_UNALIGNED 1        // word/halfword på ulige adresse
+#define MEMORY_OUT_OF_MEMORY 2    // værten kunne ikke allokere en side
+int memory_error(struct memory *mem, int *addr);
+void memory_clear_error(struct memory *mem);
+
 // skriv word/halfword/byte til lager
-void memory_wr_w(struct memory *mem, int addr, int data);
-void memory_wr_h(struct memory *mem, int addr, int data);
-void memory_wr_b(struct memory *mem, int addr, int data);
+int memory_wr_w(struct memory *mem, int addr, int data);
+int memory_wr_h(struct memory *mem, int addr, int data);
+int memory_wr_b(struct memory *mem, int addr, int data);
 
-// læs word/halfword/byte fra lager - data er nul-forlænget
+// læs word/halfword/byte fra lager - data er nul-forlænget (0 ved fejl)
 int memory_rd_w(struct memory *mem, int addr);
 int memory_rd_h(struct memory *mem, int addr);
 int memory_rd_b(struct memory *mem, int addr);
+
+// kopier en blok af 'size' bytes mellem lager og værtens hukommelse
+void memory_rd_block(struct memory *mem, int addr, void *dst, unsigned size);
+int memory_wr_block(struct memory *mem, int addr, const void *src, unsigned size);
+
+// fyld en blok med 'value'
+int memory_set_block(struct memory *mem, int addr, int value, unsigned size);
+
+// nulstil en blok; sider der dækkes helt frigives igen
+void memory_release(struct memory *mem, int addr, unsigned size);
+
+// sider (á 64KB) allokeres først når de skrives; antal i brug nu og højst. Kopier af
+// sider i et øjebliksbillede (se memory_snapshot) tæller med, da værten holder begge
+#define MEMORY_PAGE_SIZE 0x10000
+int memory_pages_in_use(struct memory *mem);
+int memory_peak_pages(struct memory *mem);
+
+// antal forskellige sider brugt siden memory_clear_touched (altid 0 med SIM_STATS=0).
+// Blok-funktionerne markerer selv siderne; de enkelte læsninger og skrivninger
+// markeres med memory_touch af den, der vil tælle dem (simulate_hart)
+void memory_touch(struct memory *mem, int addr);
+int memory_pages_touched(struct memory *mem);
+void memory_clear_touched(struct memory *mem);
+
+// øjebliksbillede af lageret plus 'state_size' bytes fra 'state' (f.eks. processorens
+// tilstand). Siderne deles copy-on-write: en side kopieres først når den skrives, og
+// kommer så på en liste over ændrede sider. Et nyt billede erstatter det forrige
+int memory_snapshot(struct memory *mem, const void *state, unsigned state_size);
+
+// tilbage til øjebliksbilledet; kun siderne ændret siden da røres. 'state' får de
+// gemte bytes. Returnerer antallet af gendannede sider, -1 hvis der ikke er noget billede
+int memory_restore(struct memory *mem, void *state);
+
+// er siden med addr ændret siden øjebliksbilledet
+int memory_page_dirty(struct memory *mem, int addr);
+
+// indholdet af side nr. 'page_number' (addr >> 16), NULL hvis den aldrig er skrevet
+const void *memory_page_data(struct memory *mem, int page_number);
+
+// brug sider direkte fra en fil mappet med mmap(MAP_PRIVATE, PROT_READ | PROT_WRITE):
+// side page_numbers[i] ligger på mapping + offset + i * MEMORY_PAGE_SIZE. Lageret
+// overtager mappingen og lukker den med munmap. Sider der allerede er i brug beholdes.
+// Returnerer -1 hvis der allerede er en mapping eller siderne ikke er i den
+int memory_map_pages(struct memory *mem, void *mapping, size_t size, size_t offset,
+                     const unsigned *page_numbers, int num_pages);
 #endif
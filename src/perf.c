@@ -0,0 +1,147 @@
+#include "perf.h"
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char* counter_names[PERF_NUM_COUNTERS] = {
+    "cycles", "instructions", "branch-misses", "cache-misses", "dTLB-misses"
+};
+
+#ifdef __linux__
+
+static int open_counter(int counter)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (counter) {
+    case PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case PERF_CACHE_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    default:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    }
+    // this process, any CPU
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_counters_open(struct perf_counters* counters)
+{
+    int available = 0;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        counters->fd[i] = open_counter(i);
+        counters->value[i] = 0;
+        available += counters->fd[i] >= 0;
+    }
+    return available;
+}
+
+void perf_counters_close(struct perf_counters* counters)
+{
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (counters->fd[i] >= 0)
+            close(counters->fd[i]);
+        counters->fd[i] = -1;
+    }
+}
+
+void perf_counters_start(struct perf_counters* counters)
+{
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+        if (counters->fd[i] >= 0) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+}
+
+void perf_counters_stop(struct perf_counters* counters)
+{
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (counters->fd[i] < 0)
+            continue;
+        ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        // value, time enabled, time running
+        uint64_t data[3];
+        // time running 0: the PMU was busy with other events all the time
+        if (read(counters->fd[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        if (data[2] < data[1])
+            data[0] = (uint64_t)((double)data[0] * data[1] / data[2]);
+        counters->value[i] += data[0];
+    }
+}
+
+#else
+
+int perf_counters_open(struct perf_counters* counters)
+{
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        counters->fd[i] = -1;
+        counters->value[i] = 0;
+    }
+    return 0;
+}
+
+void perf_counters_close(struct perf_counters* counters) { (void)counters; }
+void perf_counters_start(struct perf_counters* counters) { (void)counters; }
+void perf_counters_stop(struct perf_counters* counters) { (void)counters; }
+
+#endif
+
+int perf_counter_available(const struct perf_counters* counters, int counter)
+{
+    return counters->fd[counter] >= 0;
+}
+
+const char* perf_counter_name(int counter)
+{
+    return counter_names[counter];
+}
+
+void perf_counters_print(const struct perf_counters* counters, long int guest_insns, long int guest_branches, FILE* out)
+{
+    fprintf(out, "\nHost performance counters (user space)   per guest insn\n");
+    int any = 0;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (!perf_counter_available(counters, i))
+            continue;
+        any = 1;
+        fprintf(out, "  %-14s %16llu %16.3f\n", counter_names[i], (unsigned long long)counters->value[i],
+                guest_insns ? (double)counters->value[i] / guest_insns : 0.0);
+    }
+    if (!any) {
+        fprintf(out, "  not available (see /proc/sys/kernel/perf_event_paranoid)\n");
+        return;
+    }
+    if (perf_counter_available(counters, PERF_BRANCH_MISSES) && guest_branches)
+        fprintf(out, "  host branch misses per guest branch (taken or not): %.3f\n",
+                (double)counters->value[PERF_BRANCH_MISSES] / guest_branches);
+    if (perf_counter_available(counters, PERF_CYCLES) && perf_counter_available(counters, PERF_INSTRUCTIONS)
+        && counters->value[PERF_CYCLES])
+        fprintf(out, "  host instructions per cycle: %.2f\n",
+                (double)counters->value[PERF_INSTRUCTIONS] / counters->value[PERF_CYCLES]);
+}
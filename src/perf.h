@@ -0,0 +1,45 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Host hardware performance counters (Linux perf_event_open) around a part
+// of the run, to see where the simulator's own time goes: cycles per guest
+// instruction, mispredicted dispatch branches, cache and TLB misses from
+// memory.c page lookups.
+//
+// Each counter is opened on its own, so a counter the kernel or the CPU does
+// not have (perf_event_paranoid, virtual machines) is just missing from the
+// results. Only user space is counted.
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_NUM_COUNTERS
+};
+
+struct perf_counters {
+    int fd[PERF_NUM_COUNTERS];          // -1 if not available
+    uint64_t value[PERF_NUM_COUNTERS];  // totals, scaled if the kernel multiplexed the counter
+};
+
+// returns the number of counters available (0 if the kernel denied them all)
+int perf_counters_open(struct perf_counters* counters);
+void perf_counters_close(struct perf_counters* counters);
+
+// count between start and stop; several start/stop pairs add up
+void perf_counters_start(struct perf_counters* counters);
+void perf_counters_stop(struct perf_counters* counters);
+
+int perf_counter_available(const struct perf_counters* counters, int counter);
+const char* perf_counter_name(int counter);
+
+// the counters per guest instruction and branch misses per guest conditional
+// branch (left out when guest_branches is 0, i.e. not counted)
+void perf_counters_print(const struct perf_counters* counters, long int guest_insns, long int guest_branches, FILE* out);
+
+#endif
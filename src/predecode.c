@@ -0,0 +1,200 @@
+#include "predecode.h"
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <pthread.h>
+#define HAVE_AVX2_BUILD 1
+#endif
+
+struct predecode* predecode_create(struct memory* mem, struct program_info* info)
+{
+    struct predecode* pd = calloc(1, sizeof(struct predecode));
+    if (!pd) return NULL;
+    pd->text_start = info->text_start;
+    pd->count = info->text_end > info->text_start ? (info->text_end - info->text_start + 3) / 4 : 0;
+    size_t alloc = pd->count + 1;
+    pd->word = calloc(alloc, sizeof(uint32_t));
+    pd->id = calloc(alloc, 1);
+    pd->rd = calloc(alloc, 1);
+    pd->rs1 = calloc(alloc, 1);
+    pd->rs2 = calloc(alloc, 1);
+    pd->imm = calloc(alloc, sizeof(int32_t));
+    if (!pd->word || !pd->id || !pd->rd || !pd->rs1 || !pd->rs2 || !pd->imm) {
+        predecode_delete(pd);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < pd->count; i++)
+        pd->word[i] = memory_rd_w(mem, pd->text_start + 4 * i);
+    predecode_fill(pd, 0, pd->count);
+    return pd;
+}
+
+void predecode_delete(struct predecode* pd)
+{
+    if (!pd) return;
+    free(pd->word);
+    free(pd->id);
+    free(pd->rd);
+    free(pd->rs1);
+    free(pd->rs2);
+    free(pd->imm);
+    free(pd);
+}
+
+void predecode_fill_scalar(struct predecode* pd, uint32_t first, uint32_t n)
+{
+    for (uint32_t i = first; i < first + n; i++) {
+        struct insn insn;
+        decode(pd->word[i], &insn);
+        pd->id[i] = insn.id;
+        pd->rd[i] = insn.rd;
+        pd->rs1[i] = insn.rs1;
+        pd->rs2[i] = insn.rs2;
+        pd->imm[i] = insn.imm;
+    }
+}
+
+#ifdef HAVE_AVX2_BUILD
+
+// decode_table and insn_info widened to 32 bit entries for the gathers
+static int32_t table32[1 << DECODE_KEY_BITS];
+static int32_t mask32[NUM_INSNS];
+static int32_t match32[NUM_INSNS];
+static int32_t format32[NUM_INSNS];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+    for (int i = 0; i < (1 << DECODE_KEY_BITS); i++)
+        table32[i] = decode_table[i];
+    for (int i = 0; i < NUM_INSNS; i++) {
+        mask32[i] = insn_info[i].mask;
+        match32[i] = insn_info[i].match;
+        format32[i] = insn_info[i].format;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i field(__m256i w, int shift, int mask)
+{
+    return _mm256_and_si256(_mm256_srli_epi32(w, shift), _mm256_set1_epi32(mask));
+}
+
+// store the low byte of each of the eight lanes
+__attribute__((target("avx2")))
+static inline void store_bytes(uint8_t* dst, __m256i v)
+{
+    __m128i halves = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(halves, halves));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i select_imm(__m256i imm, __m256i format, int which, __m256i value)
+{
+    __m256i is_format = _mm256_cmpeq_epi32(format, _mm256_set1_epi32(which));
+    return _mm256_blendv_epi8(imm, value, is_format);
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(struct predecode* pd, uint32_t first, uint32_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    for (uint32_t i = first; i < first + n; i += 8) {
+        __m256i w = _mm256_loadu_si256((const __m256i*)&pd->word[i]);
+        __m256i rd = field(w, 7, 0x1f);
+
+        // same key as decode_key()
+        __m256i rd_is_x0 = _mm256_cmpeq_epi32(rd, zero);
+        __m256i key = _mm256_or_si256(
+            _mm256_or_si256(field(w, 2, 0x1f), field(w, 7, 0xe0)),
+            _mm256_or_si256(_mm256_or_si256(field(w, 17, 0x100), field(w, 21, 0x200)),
+                            _mm256_and_si256(rd_is_x0, _mm256_set1_epi32(0x400))));
+        __m256i id = _mm256_i32gather_epi32(table32, key, 4);
+        __m256i mask = _mm256_i32gather_epi32(mask32, id, 4);
+        __m256i match = _mm256_i32gather_epi32(match32, id, 4);
+        __m256i valid = _mm256_cmpeq_epi32(_mm256_and_si256(w, mask), match);
+        id = _mm256_and_si256(id, valid);
+        __m256i format = _mm256_i32gather_epi32(format32, id, 4);
+
+        // all immediate formats, then pick the one matching the format
+        __m256i imm_i = _mm256_srai_epi32(w, 20);
+        __m256i imm_shift = field(w, 20, 0x1f);
+        __m256i imm_s = _mm256_or_si256(_mm256_andnot_si256(_mm256_set1_epi32(0x1f), imm_i), field(w, 7, 0x1f));
+        __m256i imm_b = _mm256_or_si256(
+            _mm256_or_si256(_mm256_andnot_si256(_mm256_set1_epi32(0xfff), _mm256_srai_epi32(w, 19)),
+                            _mm256_and_si256(_mm256_slli_epi32(w, 4), _mm256_set1_epi32(0x800))),
+            _mm256_or_si256(field(w, 20, 0x7e0), field(w, 7, 0x1e)));
+        __m256i imm_u = _mm256_and_si256(w, _mm256_set1_epi32(0xfffff000));
+        __m256i imm_j = _mm256_or_si256(
+            _mm256_or_si256(_mm256_andnot_si256(_mm256_set1_epi32(0xfffff), _mm256_srai_epi32(w, 11)),
+                            _mm256_and_si256(w, _mm256_set1_epi32(0xff000))),
+            _mm256_or_si256(field(w, 9, 0x800), field(w, 20, 0x7fe)));
+        __m256i imm = zero;
+        imm = select_imm(imm, format, FMT_I, imm_i);
+        imm = select_imm(imm, format, FMT_LOAD, imm_i);
+        imm = select_imm(imm, format, FMT_SHIFT, imm_shift);
+        imm = select_imm(imm, format, FMT_S, imm_s);
+        imm = select_imm(imm, format, FMT_B, imm_b);
+        imm = select_imm(imm, format, FMT_U, imm_u);
+        imm = select_imm(imm, format, FMT_J, imm_j);
+
+        store_bytes(&pd->id[i], id);
+        store_bytes(&pd->rd[i], rd);
+        store_bytes(&pd->rs1[i], field(w, 15, 0x1f));
+        store_bytes(&pd->rs2[i], field(w, 20, 0x1f));
+        _mm256_storeu_si256((__m256i*)&pd->imm[i], imm);
+    }
+}
+
+int predecode_fill_avx2(struct predecode* pd, uint32_t first, uint32_t n)
+{
+    if (!__builtin_cpu_supports("avx2"))
+        return 0;
+    pthread_once(&tables_once, init_tables);
+    // whole vectors only; the rest is done one at a time
+    uint32_t vector_n = n & ~7u;
+    fill_avx2(pd, first, vector_n);
+    predecode_fill_scalar(pd, first + vector_n, n - vector_n);
+    return 1;
+}
+
+#else
+
+int predecode_fill_avx2(struct predecode* pd, uint32_t first, uint32_t n)
+{
+    (void)pd;
+    (void)first;
+    (void)n;
+    return 0;
+}
+
+#endif
+
+void predecode_fill(struct predecode* pd, uint32_t first, uint32_t n)
+{
+    if (!predecode_fill_avx2(pd, first, n))
+        predecode_fill_scalar(pd, first, n);
+}
+
+void predecode_update(struct predecode* pd, uint32_t addr, struct memory* mem)
+{
+    int64_t index = predecode_index(pd, addr & ~3u);
+    if (index < 0) return;
+    pd->word[index] = memory_rd_w(mem, addr & ~3u);
+    predecode_fill_scalar(pd, index, 1);
+}
+
+void predecode_update_range(struct predecode* pd, uint32_t addr, uint32_t size, struct memory* mem)
+{
+    // only the part that overlaps the text segment; most writes are data
+    uint64_t text_end = pd->text_start + 4 * (uint64_t)pd->count;
+    uint64_t start = addr & ~3u;
+    uint64_t end = (uint64_t)addr + size;
+    if (start < pd->text_start)
+        start = pd->text_start;
+    if (end > text_end)
+        end = text_end;
+    for (uint64_t a = start; a < end; a += 4)
+        predecode_update(pd, (uint32_t)a, mem);
+}
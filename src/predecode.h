@@ -0,0 +1,58 @@
+#ifndef __PREDECODE_H__
+#define __PREDECODE_H__
+
+#include "decode.h"
+#include "memory.h"
+#include "read_elf.h"
+#include <stdint.h>
+
+// The text segment decoded up front, as a structure of arrays indexed by
+// (addr - text_start) / 4. simulate() and the disassembler read instructions
+// from here instead of decoding them again and again.
+struct predecode {
+    uint32_t text_start;
+    uint32_t count;       // number of instruction words
+    uint32_t* word;       // the raw instruction words
+    uint8_t* id;          // enum insn_id
+    uint8_t* rd;
+    uint8_t* rs1;
+    uint8_t* rs2;
+    int32_t* imm;
+};
+
+// decode the text segment described by info
+struct predecode* predecode_create(struct memory* mem, struct program_info* info);
+void predecode_delete(struct predecode* pd);
+
+// decode pd->word[first .. first+n) into the other arrays. predecode_fill picks
+// the fastest implementation available on this host. predecode_fill_avx2
+// returns 0 (and does nothing) if the host has no AVX2.
+void predecode_fill(struct predecode* pd, uint32_t first, uint32_t n);
+void predecode_fill_scalar(struct predecode* pd, uint32_t first, uint32_t n);
+int predecode_fill_avx2(struct predecode* pd, uint32_t first, uint32_t n);
+
+// index of the instruction at addr, or -1 if addr is not an aligned
+// address inside the text segment
+static inline int64_t predecode_index(const struct predecode* pd, uint32_t addr)
+{
+    uint32_t offset = addr - pd->text_start;
+    // rotating the low bits to the top makes unaligned offsets huge
+    uint32_t index = (offset >> 2) | (offset << 30);
+    return index < pd->count ? (int64_t)index : -1;
+}
+
+static inline void predecode_get(const struct predecode* pd, uint32_t index, struct insn* insn)
+{
+    insn->id = pd->id[index];
+    insn->rd = pd->rd[index];
+    insn->rs1 = pd->rs1[index];
+    insn->rs2 = pd->rs2[index];
+    insn->imm = pd->imm[index];
+}
+
+// the simulated program wrote to addr; re-decode the word there if it is in the text segment
+void predecode_update(struct predecode* pd, uint32_t addr, struct memory* mem);
+// the same for a block of 'size' bytes written by the host (system calls etc.)
+void predecode_update_range(struct predecode* pd, uint32_t addr, uint32_t size, struct memory* mem);
+
+#endif
@@ -0,0 +1,97 @@
+#include "profile.h"
+#include "disassemble.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct profile* profile_create(const struct predecode* pd)
+{
+    struct profile* profile = calloc(1, sizeof(struct profile));
+    if (!profile)
+        return NULL;
+    profile->text_start = pd->text_start;
+    profile->count = pd->count;
+    // one more, so an empty text segment still gets an allocation
+    profile->executed = calloc(pd->count + 1, sizeof(uint64_t));
+    profile->taken = calloc(pd->count + 1, sizeof(uint64_t));
+    if (!profile->executed || !profile->taken) {
+        profile_delete(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+void profile_delete(struct profile* profile)
+{
+    if (!profile)
+        return;
+    free(profile->executed);
+    free(profile->taken);
+    free(profile);
+}
+
+void profile_clear(struct profile* profile)
+{
+    memset(profile->executed, 0, profile->count * sizeof(uint64_t));
+    memset(profile->taken, 0, profile->count * sizeof(uint64_t));
+}
+
+// from the instruction word: pd->id may hold an intercept or a breakpoint
+static int is_branch(uint32_t instruction)
+{
+    struct insn insn;
+    decode(instruction, &insn);
+    return insn_info[insn.id].format == FMT_B;
+}
+
+// Prints the lines [first, end) if any of them ran
+static void print_region(const struct profile* profile, const struct predecode* pd, struct symbols* symbols,
+                         const char* name, uint32_t first, uint32_t end, uint64_t total, FILE* out)
+{
+    uint64_t executed = 0;
+    for (uint32_t i = first; i < end; i++)
+        executed += profile->executed[i];
+    if (executed == 0)
+        return;
+    uint32_t addr = profile->text_start + 4 * first;
+    if (name)
+        fprintf(out, "\n%08x <%s>: %llu instructions, %.2f%%\n", addr, name, (unsigned long long)executed, 100.0 * executed / total);
+    else
+        fprintf(out, "\n%08x: %llu instructions, %.2f%%\n", addr, (unsigned long long)executed, 100.0 * executed / total);
+    for (uint32_t i = first; i < end; i++, addr += 4) {
+        uint64_t count = profile->executed[i];
+        double percent = 100.0 * count / total;
+        char disassembly[64];
+        disassemble(addr, pd->word[i], disassembly, sizeof(disassembly), symbols);
+        fprintf(out, "%c %12llu %6.2f%% ", percent >= PROFILE_HOT_PERCENT ? '>' : ' ', (unsigned long long)count, percent);
+        // a branch that ran: how often it was taken
+        if (count && is_branch(pd->word[i]))
+            fprintf(out, "%5.1f%% taken ", 100.0 * profile->taken[i] / count);
+        else
+            fprintf(out, "             ");
+        fprintf(out, "%8x : %08X       %s\n", addr, pd->word[i], disassembly);
+    }
+}
+
+void profile_print(const struct profile* profile, const struct predecode* pd, struct symbols* symbols, FILE* out)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < profile->count; i++)
+        total += profile->executed[i];
+    fprintf(out, "Execution profile: %llu instructions in the text segment\n"
+                 "  (lines marked '>' ran at least %.1f%% of them)\n", (unsigned long long)total, PROFILE_HOT_PERCENT);
+    if (total == 0)
+        return;
+    // cut the text segment at the symbols
+    uint32_t first = 0;
+    const char* name = symbols ? symbols_value_to_sym(symbols, profile->text_start) : NULL;
+    for (uint32_t i = 1; i <= profile->count; i++) {
+        const char* next_name = NULL;
+        if (i < profile->count && symbols)
+            next_name = symbols_value_to_sym(symbols, profile->text_start + 4 * i);
+        if (i == profile->count || next_name) {
+            print_region(profile, pd, symbols, name, first, i, total, out);
+            first = i;
+            name = next_name;
+        }
+    }
+}
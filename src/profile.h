@@ -0,0 +1,35 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "predecode.h"
+#include "read_elf.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Execution profile of the text segment: how often each instruction ran and,
+// for branches and jumps, how often it went somewhere else than the next
+// instruction. simulate_hart fills it in (see interpreter.inc); profile_print
+// writes it as an annotated disassembly, like 'perf annotate' for the
+// simulated program.
+
+struct profile {
+    uint32_t text_start;
+    uint32_t count;         // instructions in the text segment
+    uint64_t* executed;     // per instruction
+    uint64_t* taken;
+};
+
+// for the text segment of pd; NULL if out of memory
+struct profile* profile_create(const struct predecode* pd);
+void profile_delete(struct profile* profile);
+void profile_clear(struct profile* profile);
+
+// The listing has a header per symbol with the instructions run there, and
+// the lines of each symbol that ran in the -d format with the count, its share
+// of all instructions and the taken ratio of branches in front. Lines with at
+// least PROFILE_HOT_PERCENT of the instructions are marked with '>'; symbols
+// where nothing ran are left out
+#define PROFILE_HOT_PERCENT 1.0
+void profile_print(const struct profile* profile, const struct predecode* pd, struct symbols* symbols, FILE* out);
+
+#endif
@@ -6,104 +6,96 @@
 #include <string.h>
 #include "elf.h"
 
+// error messages go to log_file, if there is one
+static int elf_error(FILE* log_file, int error, const char* message) {
+    if (log_file)
+        fprintf(log_file, "%s\n", message);
+    return error;
+}
+
 int read_elf(struct memory* mem, struct program_info* info, const char *filename, FILE *log_file) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
-        fprintf(log_file, "Error opening file");
-        return -1;
+        return elf_error(log_file, READ_ELF_OPEN_ERROR, "Error opening file");
     }
+    int result = READ_ELF_OK;
+    unsigned char *segment_data = NULL;
 
     // Read the ELF header
     Elf32_Ehdr elf_header;
-    unsigned stat = fread(&elf_header, 1, sizeof(Elf32_Ehdr), file);
-    if (stat != sizeof(Elf32_Ehdr)) {
-        fprintf(log_file, "Elf file error, file shorter than minimal header size.\n");
-        fclose(file);
-        return -1;
+    if (fread(&elf_header, 1, sizeof(Elf32_Ehdr), file) != sizeof(Elf32_Ehdr)) {
+        result = elf_error(log_file, READ_ELF_FORMAT_ERROR, "Elf file error, file shorter than minimal header size.");
+        goto done;
     }
 
     // Check for ELF magic number
     if (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) {
-        fprintf(log_file, "Not a valid ELF file.\n");
-        fclose(file);
-        return -1;
+        result = elf_error(log_file, READ_ELF_FORMAT_ERROR, "Not a valid ELF file.");
+        goto done;
     }
 
     // Seek to the program header table and read program headers
     info->text_start = 0;
     info->text_end = 0;
+    info->data_end = 0;
     info->start = elf_header.e_entry;
-    //printf("Program headers starting at offset %d\n", elf_header.e_phoff);
-    //printf("Program entry point address: 0x%x\n", info->start);
-    //printf("Text offset 0x%x\n\n", info->text_start);
     Elf32_Phdr program_header;
     for (int i = 0; i < elf_header.e_phnum; i++) {
         fseek(file, elf_header.e_phoff + i * sizeof(Elf32_Phdr), SEEK_SET);
-        stat = fread(&program_header, 1, sizeof(Elf32_Phdr), file);
-        if (stat != sizeof(Elf32_Phdr)) {
-            fprintf(log_file, "Elf file error, file shorter than minimal prog header size.\n");
-            fclose(file);
-            return -1;
+        if (fread(&program_header, 1, sizeof(Elf32_Phdr), file) != sizeof(Elf32_Phdr)) {
+            result = elf_error(log_file, READ_ELF_FORMAT_ERROR, "Elf file error, file shorter than minimal prog header size.");
+            goto done;
+        }
+
+        // Only loadable segments (PT_LOAD) go into memory
+        if (program_header.p_type != PT_LOAD)
+            continue;
+        if (program_header.p_vaddr + program_header.p_memsz > info->data_end)
+            info->data_end = program_header.p_vaddr + program_header.p_memsz;
+        if (program_header.p_flags & PF_X) {
+            // Executable (.text); the headers are loaded with it
+            info->text_start = program_header.p_vaddr + (unsigned int)(sizeof(Elf32_Ehdr) + elf_header.e_phnum * sizeof(Elf32_Phdr));
+            info->text_end = program_header.p_vaddr + program_header.p_filesz;
         }
 
-        // Check for loadable segments (PT_LOAD)
-        if (program_header.p_type == PT_LOAD) {
-            // const char *segment_type = NULL;
-
-            // Identify segment type
-            if (program_header.p_flags & PF_X) {
-                // segment_type = "Executable (.text)";
-                info->text_start = program_header.p_vaddr + (unsigned int)(sizeof(Elf32_Ehdr) + elf_header.e_phnum * sizeof(Elf32_Phdr));
-                info->text_end = program_header.p_vaddr + program_header.p_filesz;
-            } else if (program_header.p_flags & PF_W) {
-                // segment_type = "Writable (static data)";
-            } else {
-                // segment_type = "Read-only (e.g., .rodata)";
-            }
-
-            //printf("Found %s segment at offset 0x%x, size 0x%x, in-memory address 0x%x\n",
-            //      segment_type, program_header.p_offset, program_header.p_filesz, program_header.p_vaddr);
-
-            // Allocate buffer for the segment
-            unsigned char *segment_data = malloc(program_header.p_filesz);
-            if (!segment_data) {
-                fprintf(log_file, "Error allocating memory for segment\n");
-                fclose(file);
-                return -1;
-            }
-
-            // Read the segment data
-            fseek(file, program_header.p_offset, SEEK_SET);
-            stat = fread(segment_data, 1, program_header.p_filesz, file);
-            if (stat != program_header.p_filesz) {
-                fprintf(log_file, "Error reading segment - failed to read entire segment in one go\n");
-                return -1;
-            }
-
-            // Process the segment data (e.g., print or analyze)
-            // printf("All bytes of %s segment:\n", segment_type);
-            for (unsigned int j = 0; j < program_header.p_filesz; j++) {
-                // printf("%02x ", segment_data[j]);
-                memory_wr_b(mem, program_header.p_vaddr + j, segment_data[j]);
-            }
-            /*
-            printf("\n\nDisassembly\n");
-            for (unsigned int j = info->text_start; j < program_header.p_filesz; j += 4) {
-                unsigned int addr = program_header.p_vaddr + j;
-                int inst = memory_rd_w(mem, addr);
-                const int buf_sz = 64;
-                char buf[buf_sz];
-                decode_rv32i(addr, inst, buf, buf_sz);
-                // printf("%6x %8x   %s\n", j, inst, buf);
-            }
-            printf("\n");
-            */
-            free(segment_data);
+        // Read the segment data and copy it into simulated memory
+        segment_data = malloc(program_header.p_filesz ? program_header.p_filesz : 1);
+        if (!segment_data) {
+            result = elf_error(log_file, READ_ELF_NO_MEMORY, "Error allocating memory for segment");
+            goto done;
+        }
+        fseek(file, program_header.p_offset, SEEK_SET);
+        if (fread(segment_data, 1, program_header.p_filesz, file) != program_header.p_filesz) {
+            result = elf_error(log_file, READ_ELF_FORMAT_ERROR, "Error reading segment - failed to read entire segment in one go");
+            goto done;
+        }
+        if (memory_wr_block(mem, program_header.p_vaddr, segment_data, program_header.p_filesz) != MEMORY_OK) {
+            result = elf_error(log_file, READ_ELF_NO_MEMORY, "Error allocating memory for segment");
+            goto done;
         }
+        free(segment_data);
+        segment_data = NULL;
     }
-    // adjust program info to virtual addresses instead of file offsets
+done:
+    free(segment_data);
     fclose(file);
-    return 0;
+    return result;
+}
+
+void program_args_to_memory(struct memory* mem, int num_args, char* args[]) {
+    unsigned count_addr = 0x1000000;
+    unsigned argv_addr = 0x1000004;
+    unsigned str_addr = argv_addr + 4 * num_args;
+    memory_wr_w(mem, count_addr, num_args);
+    for (int index = 0; index < num_args; ++index) {
+        memory_wr_w(mem, argv_addr + 4 * index, str_addr);
+        char* cp = args[index];
+        int c;
+        do {
+            c = *cp++;
+            memory_wr_b(mem, str_addr++, c);
+        } while (c);
+    }
 }
 
 struct symbols {
@@ -114,38 +106,24 @@ struct symbols {
 
 struct symbols* symbols_read_from_elf(const char *filename) {
     FILE *file = fopen(filename, "rb");
-    if (!file) {
-        perror("Error opening file");
+    if (!file)
         return NULL;
-    }
+    Elf32_Shdr *section_headers = NULL;
+    struct symbols* symbols = NULL;
 
-    // Read the ELF header
+    // Read the ELF header and check for the ELF magic number
     Elf32_Ehdr elf_header;
-    int status = fread(&elf_header, 1, sizeof(Elf32_Ehdr), file);
-    if (status != sizeof(Elf32_Ehdr)) {
-        fprintf(stderr, "Not a valid ELF file.\n");
-        fclose(file);
-        return NULL;
-    }
-
-    // Check for ELF magic number
-    if (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) {
-        fprintf(stderr, "Not a valid ELF file.\n");
-        fclose(file);
-        return NULL;
-    }
-
-    // Seek to the section header table
-    fseek(file, elf_header.e_shoff, SEEK_SET);
+    if (fread(&elf_header, 1, sizeof(Elf32_Ehdr), file) != sizeof(Elf32_Ehdr)
+        || memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0)
+        goto fail;
 
     // Read all section headers
-    Elf32_Shdr *section_headers = malloc(elf_header.e_shnum * sizeof(Elf32_Shdr));
-    status = fread(section_headers, elf_header.e_shnum, sizeof(Elf32_Shdr), file);
-    if (status != sizeof(Elf32_Shdr)) {
-        fprintf(stderr, "While reading ELF file: Invalid section header.\n");
-        fclose(file);
-        return NULL;
-    }
+    section_headers = malloc(elf_header.e_shnum * sizeof(Elf32_Shdr) + 1);
+    if (!section_headers)
+        goto fail;
+    fseek(file, elf_header.e_shoff, SEEK_SET);
+    if (fread(section_headers, sizeof(Elf32_Shdr), elf_header.e_shnum, file) != elf_header.e_shnum)
+        goto fail;
 
     // Locate the symbol table and the string table
     Elf32_Shdr *symtab_section = NULL;
@@ -158,54 +136,51 @@ struct symbols* symbols_read_from_elf(const char *filename) {
             strtab_section = &section_headers[i];
         }
     }
+    if (!symtab_section || !strtab_section)
+        goto fail;
 
-    if (!symtab_section || !strtab_section) {
-        fprintf(stderr, "No symbol table found.\n");
-        free(section_headers);
-        fclose(file);
-        return NULL;
-    }
-
-    struct symbols* symbols = malloc(sizeof(struct symbols));
+    symbols = calloc(1, sizeof(struct symbols));
+    if (!symbols)
+        goto fail;
     // Read the string table
-    symbols->strtab = malloc(strtab_section->sh_size);
+    symbols->strtab = malloc(strtab_section->sh_size + 1);
+    if (!symbols->strtab)
+        goto fail;
     fseek(file, strtab_section->sh_offset, SEEK_SET);
-    status = fread(symbols->strtab, 1, strtab_section->sh_size, file);
-    if ((unsigned int)status != strtab_section->sh_size) {
-        fprintf(stderr, "Error, unable to read string table in one go.\n");
-        fclose(file);
-        return NULL;
-    }
+    if (fread(symbols->strtab, 1, strtab_section->sh_size, file) != strtab_section->sh_size)
+        goto fail;
+    symbols->strtab[strtab_section->sh_size] = 0;
 
     // Read the symbol table entries
     symbols->num_symbols = symtab_section->sh_size / sizeof(Elf32_Sym);
-    symbols->symbols = malloc(symtab_section->sh_size);
+    symbols->symbols = malloc(symtab_section->sh_size + 1);
+    if (!symbols->symbols)
+        goto fail;
     fseek(file, symtab_section->sh_offset, SEEK_SET);
-    status = fread(symbols->symbols, symbols->num_symbols, sizeof(Elf32_Sym), file);
-    if (status != sizeof(Elf32_Sym)) {
-        fprintf(stderr, "Error, unable to read symbol table entry.\n");
-        fclose(file);
-        return NULL;
-    }
+    if (fread(symbols->symbols, sizeof(Elf32_Sym), symbols->num_symbols, file) != (size_t)symbols->num_symbols)
+        goto fail;
+    // names pointing outside the string table would be read out of bounds
+    for (int i = 0; i < symbols->num_symbols; i++)
+        if (symbols->symbols[i].st_name >= strtab_section->sh_size)
+            symbols->symbols[i].st_name = strtab_section->sh_size;
 
-    // Print symbols
-    /* printf("Symbols:\n");
-    for (int i = 0; i < symbols->num_symbols; i++) {
-        const char *name = &symbols->strtab[symbols->symbols[i].st_name];
-        printf("Name: %-50s Address: 0x%-8x Size: %3d Type: %2d Binding: %2d\n",
-               name,
-               symbols->symbols[i].st_value,
-               symbols->symbols[i].st_size,
-               ELF32_ST_TYPE(symbols->symbols[i].st_info),
-               ELF32_ST_BIND(symbols->symbols[i].st_info));
-    }
-    */
-    // Free allocated memory
-    // free(strtab);
-    // free(symbols);
     free(section_headers);
     fclose(file);
     return symbols;
+
+fail:
+    symbols_delete(symbols);
+    free(section_headers);
+    fclose(file);
+    return NULL;
+}
+
+void symbols_delete(struct symbols* symbols) {
+    if (!symbols)
+        return;
+    free(symbols->strtab);
+    free(symbols->symbols);
+    free(symbols);
 }
 
 
@@ -219,3 +194,16 @@ const char* symbols_value_to_sym(struct symbols* symbols, unsigned int value)
     return NULL;
 }
 
+
+int symbols_sym_to_value(struct symbols* symbols, const char* name, unsigned int* value)
+{
+    for (int i = 0; i < symbols->num_symbols; i++) {
+        Elf32_Sym* sym = &symbols->symbols[i];
+        if (sym->st_shndx != SHN_UNDEF && ELF32_ST_BIND(sym->st_info)
+            && !strcmp(&symbols->strtab[sym->st_name], name)) {
+            *value = sym->st_value;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -9,14 +9,24 @@ struct program_info {
     unsigned int text_start;
     unsigned int text_end;
     unsigned int start;
+    unsigned int data_end;    // end of the highest loaded segment, including bss
 };
 
-// read file into simulated memory, fill in program info
+// read file into simulated memory, fill in program info. Returns READ_ELF_OK
+// or one of the negative error codes; a message also goes to log_file if it is not NULL
+#define READ_ELF_OK            0
+#define READ_ELF_OPEN_ERROR   -1    // the file could not be opened
+#define READ_ELF_FORMAT_ERROR -2    // not a (complete) ELF file
+#define READ_ELF_NO_MEMORY    -3
 int read_elf(struct memory* mem, struct program_info* info, const char* file_name, FILE *log_file);
 
+// place the arguments to the simulated program in memory: the count at
+// 0x1000000 followed by argv and the strings. args[0] is '--' by convention
+void program_args_to_memory(struct memory* mem, int num_args, char* args[]);
+
 struct symbols;
 
-// read symbol table from elf file
+// read symbol table from elf file (NULL if it has none or cannot be read)
 struct symbols* symbols_read_from_elf(const char* file_name);
 
 // delete symbol table after use
@@ -25,5 +35,8 @@ void symbols_delete(struct symbols* symbols);
 // map a value to a symbol (return NULL if no matching symbol found)
 const char* symbols_value_to_sym(struct symbols* symbols, unsigned int value);
 
+// map a symbol name to its value (return 0 if the symbol is not defined)
+int symbols_sym_to_value(struct symbols* symbols, const char* name, unsigned int* value);
+
 
 #endif
@@ -0,0 +1,150 @@
+#include "server.h"
+#include "simulate.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_ARGS 256
+
+static void write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+// read until end of file; returns the number of bytes read or -1
+static ssize_t read_all(int fd, char** data, size_t* cap)
+{
+    size_t len = 0;
+    for (;;) {
+        if (len == *cap) {
+            size_t new_cap = *cap ? 2 * *cap : 1 << 16;
+            char* grown = realloc(*data, new_cap);
+            if (!grown) return -1;
+            *data = grown;
+            *cap = new_cap;
+        }
+        ssize_t got = read(fd, *data + len, *cap - len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return -1;
+        if (got == 0) return len;
+        len += got;
+    }
+}
+
+// split the request line into program arguments, with '--' first
+static int split_args(char* line, char* args[])
+{
+    static char separator[] = "--";
+    int num_args = 0;
+    for (char* token = strtok(line, " \t\r\n"); token && num_args < MAX_ARGS; token = strtok(NULL, " \t\r\n")) {
+        if (num_args == 0 && strcmp(token, "--"))
+            args[num_args++] = separator;
+        args[num_args++] = token;
+    }
+    return num_args;
+}
+
+// in the child: run the program and send its statistics through result_fd
+static void child(struct server_program* program, char* args[], int num_args, int output_fd, int result_fd)
+{
+    if (num_args)
+        program_args_to_memory(program->mem, num_args, args);
+    int input_fd = open("/dev/null", O_RDONLY);
+    struct console* console = console_create(input_fd, output_fd, CONSOLE_FULL);
+    struct syscalls* syscalls = syscalls_create(0);
+    if (!console || !syscalls)
+        _exit(1);
+    syscalls_init_heap(syscalls, program->info->data_end);
+    struct Stat stats = simulate(program->mem, program->info->start, NULL, program->symbols, program->pd,
+                                 console, syscalls, program->intercepts);
+    console_delete(console);
+    simulate_print_fault(stderr, &stats);
+    close(output_fd);
+    write_all(result_fd, (const char*)&stats, sizeof(stats));
+    _exit(0);
+}
+
+static void serve(struct server_program* program, char* line, int out_fd, char** output, size_t* output_cap)
+{
+    char* args[MAX_ARGS + 1];
+    int num_args = split_args(line, args);
+    int output_pipe[2], result_pipe[2];
+    pid_t pid = -1;
+    if (pipe(output_pipe) == 0) {
+        if (pipe(result_pipe) == 0) {
+            pid = fork();
+            if (pid < 0) {
+                close(result_pipe[0]);
+                close(result_pipe[1]);
+            }
+        }
+        if (pid < 0) {
+            close(output_pipe[0]);
+            close(output_pipe[1]);
+        }
+    }
+    if (pid < 0) {
+        // no child to run the request in; the server goes on with the next one
+        static const char failed[] = "failed -1 insns 0 intercepted 0 output 0\n";
+        write_all(out_fd, failed, sizeof(failed) - 1);
+        return;
+    }
+    if (pid == 0) {
+        close(output_pipe[0]);
+        close(result_pipe[0]);
+        child(program, args, num_args, output_pipe[1], result_pipe[1]);
+    }
+    close(output_pipe[1]);
+    close(result_pipe[1]);
+    ssize_t output_len = read_all(output_pipe[0], output, output_cap);
+    if (output_len < 0) output_len = 0;
+    struct Stat stats;
+    ssize_t got;
+    do {
+        got = read(result_pipe[0], &stats, sizeof(stats));
+    } while (got < 0 && errno == EINTR);
+    close(output_pipe[0]);
+    close(result_pipe[0]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    char header[128];
+    int header_len;
+    if (got == sizeof(stats) && stats.fault) {
+        header_len = snprintf(header, sizeof(header), "fault %d insns %ld intercepted %ld output %zd\n",
+                              stats.fault, stats.insns, stats.intercepted, output_len);
+    } else if (got == sizeof(stats)) {
+        header_len = snprintf(header, sizeof(header), "exit %d insns %ld intercepted %ld output %zd\n",
+                              stats.exit_code, stats.insns, stats.intercepted, output_len);
+    } else {
+        int host_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        header_len = snprintf(header, sizeof(header), "failed %d insns 0 intercepted 0 output %zd\n",
+                              host_status, output_len);
+    }
+    write_all(out_fd, header, header_len);
+    write_all(out_fd, *output, output_len);
+}
+
+void server_run(struct server_program* program, FILE* in, int out_fd)
+{
+    char* line = NULL;
+    size_t line_cap = 0;
+    char* output = NULL;
+    size_t output_cap = 0;
+    while (getline(&line, &line_cap, in) >= 0)
+        serve(program, line, out_fd, &output, &output_cap);
+    free(line);
+    free(output);
+}
@@ -0,0 +1,37 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "memory.h"
+#include "read_elf.h"
+#include "predecode.h"
+#include "intercept.h"
+#include <stdio.h>
+
+// Fork server: the program is loaded and decoded once, and each line read from
+// 'in' runs it in a fork()ed child on a copy-on-write copy of the loaded memory.
+//
+// A request line holds the arguments to the simulated program, as they would
+// follow '--' on the command line (the '--' itself may be left out). For each
+// request one response is written to out_fd:
+//
+//   exit <code> insns <n> intercepted <n> output <bytes>\n<bytes of output>
+//
+// If the program stopped on a fault (see enum sim_fault) the line starts with
+// 'fault <sim_fault>' instead of 'exit <code>', and if the simulator itself
+// died it is
+//
+//   failed <host exit status> insns 0 intercepted 0 output <bytes>\n<bytes of output>
+//
+// with status -1 (and no output) if no child could be started for it.
+// The simulated program reads an empty stdin. Returns when 'in' ends.
+struct server_program {
+    struct memory* mem;
+    struct program_info* info;
+    struct symbols* symbols;
+    struct predecode* pd;
+    struct intercepts* intercepts;  // may be NULL
+};
+
+void server_run(struct server_program* program, FILE* in, int out_fd);
+
+#endif
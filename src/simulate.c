@@ -1,7 +1,405 @@
 #include "simulate.h"
+#include "decode.h"
+#include "disassemble.h"
+#include "format.h"
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols) {
-    
+// Names used by the instruction semantics in rv32im.isa
+#define RD regs[insn.rd]
+#define RS1 a
+#define RS2 b
+#define IMM insn.imm
+#define PC pc
+#define NEXT_PC next_pc
+#define LOAD_B(addr) (TOUCH(addr), memory_rd_b(mem, addr))
+#define LOAD_H(addr) LOAD(2, addr)
+#define LOAD_W(addr) LOAD(4, addr)
+#define STORE_B(addr, value) STORE(1, addr, value)
+#define STORE_H(addr, value) STORE(2, addr, value)
+#define STORE_W(addr, value) STORE(4, addr, value)
+// only the interpreter variants with statistics count the pages used (see interpreter.inc)
+#define TOUCH(addr) (INTERP_STATS ? memory_touch(mem, addr) : (void)0)
+// A fault leaves the interpreter loop through 'stop' (see interpreter.inc)
+// before rd is written, pc moves on or the instruction is counted, so the
+// hart stops precisely at the faulting instruction
+#define STOP_ON_FAULT(kind, value) \
+    do { \
+        running = fault(&stats, kind, pc, value); \
+        goto stop; \
+    } while (0)
+#define LOAD(size, addr) __extension__ ({ \
+        uint32_t load_addr = (addr); \
+        TOUCH(load_addr); \
+        if (load_addr & (size - 1)) \
+            STOP_ON_FAULT(SIM_FAULT_UNALIGNED, load_addr); \
+        size == 2 ? memory_rd_h(mem, load_addr) : memory_rd_w(mem, load_addr); \
+    })
+#define STORE(size, addr, value) __extension__ ({ \
+        uint32_t store_addr = (addr); \
+        TOUCH(store_addr); \
+        int error = store(mem, pd, size, store_addr, value); \
+        if (error != MEMORY_OK) \
+            STOP_ON_FAULT(error == MEMORY_UNALIGNED ? SIM_FAULT_UNALIGNED : SIM_FAULT_OUT_OF_MEMORY, store_addr); \
+    })
+// the log shows the system call number in place of rs1
+#define SYSCALL() \
+    do { \
+        a = regs[REG_A7]; \
+        syscall_ctx.pc = pc; \
+        running = syscalls_call(syscalls, &syscall_ctx); \
+        if (running < 0) \
+            STOP_ON_FAULT(SIM_FAULT_UNKNOWN_SYSCALL, a); \
+    } while (0)
+
+#define LOG_BUF_SIZE (1 << 16)
+#define LOG_DISASM_WIDTH 32
+
+// record why the simulation stopped; returns the new value of 'running'
+static int fault(struct Stat* stats, int kind, uint32_t pc, uint32_t value)
+{
+    stats->fault = kind;
+    stats->fault_pc = pc;
+    stats->fault_value = value;
+    return 0;
+}
+
+// Stores into the text segment must also update the predecoded instructions.
+// Returns MEMORY_OK or the error of the memory
+static inline int store(struct memory* mem, struct predecode* pd, int size, uint32_t addr, uint32_t value)
+{
+    int error;
+    if (size == 1) error = memory_wr_b(mem, addr, value);
+    else if (size == 2) error = memory_wr_h(mem, addr, value);
+    else error = memory_wr_w(mem, addr, value);
+    if (error == MEMORY_OK && predecode_index(pd, addr & ~3u) >= 0)
+        predecode_update(pd, addr, mem);
+    return error;
+}
+
+// One line of the execution log:
+//    144 =>  10098 : 00044503     lbu x10, 0(x8)                   R[10] <- 6e
+static void log_insn(struct fmt_buf* log, long int insn_number, int jumped, uint32_t pc,
+                     uint32_t instruction, const struct insn* insn, const uint32_t* regs,
+                     uint32_t next_pc, uint32_t rs1_value, uint32_t rs2_value, struct symbols* symbols,
+                     struct syscalls* syscalls)
+{
+    char disassembly[64];
+    disassemble(pc, instruction, disassembly, sizeof(disassembly), symbols);
+
+    fmt_udec_pad(log, insn_number, 6);
+    fmt_mem(log, jumped ? " => " : "    ", 4);
+    fmt_hex(log, pc, 6, ' ', 0);
+    fmt_mem(log, " : ", 3);
+    fmt_hex(log, instruction, 8, '0', 0);
+    fmt_mem(log, "     ", 5);
+    fmt_str(log, disassembly);
+
+    // the effect of the instruction, if any, goes in a column of its own
+    char effect_storage[48];
+    struct fmt_buf effect;
+    fmt_init(&effect, effect_storage, sizeof(effect_storage), -1);
+    switch (insn_info[insn->id].format) {
+    case FMT_R:
+    case FMT_I:
+    case FMT_SHIFT:
+    case FMT_LOAD:
+    case FMT_U:
+    case FMT_J:
+        if (insn->rd) {
+            fmt_mem(&effect, "R[", 2);
+            fmt_udec_pad(&effect, insn->rd, 2);
+            fmt_mem(&effect, "] <- ", 5);
+            fmt_hex(&effect, regs[insn->rd], 0, '0', 0);
+        }
+        break;
+    case FMT_S: {
+        uint32_t addr = rs1_value + insn->imm;
+        uint32_t value = rs2_value;
+        if (insn->id == INSN_SB) value &= 0xff;
+        else if (insn->id == INSN_SH) value &= 0xffff;
+        fmt_mem(&effect, "M[", 2);
+        fmt_hex(&effect, addr, 0, '0', 0);
+        fmt_mem(&effect, "] <- ", 5);
+        fmt_hex(&effect, value, 0, '0', 0);
+        break;
+    }
+    case FMT_B:
+        if (next_pc != pc + 4)
+            fmt_mem(&effect, "{T}", 3);
+        break;
+    case FMT_SYS: {
+        struct syscall_entry* entry = syscalls_lookup(syscalls, rs1_value);
+        if (entry && entry->returns_value) {
+            fmt_mem(&effect, "R[10] <- ", 9);
+            fmt_hex(&effect, regs[REG_A0], 0, '0', 0);
+        }
+        break;
+    }
+    }
+    if (effect.len) {
+        fmt_fill(log, ' ', LOG_DISASM_WIDTH - (int)strlen(disassembly));
+        fmt_mem(log, effect_storage, effect.len);
+    }
+    fmt_char(log, '\n');
+}
+
+// An intercepted call in the execution log:
+//           10280 : <host print_string>              R[10] <- 11570
+static void log_intercept(struct fmt_buf* log, uint32_t pc, const char* name, const uint32_t* regs)
+{
+    fmt_fill(log, ' ', 10);
+    fmt_hex(log, pc, 6, ' ', 0);
+    fmt_mem(log, " : <host ", 9);
+    fmt_str(log, name);
+    fmt_char(log, '>');
+    // the effect in the same column as for instructions
+    fmt_fill(log, ' ', LOG_DISASM_WIDTH + 6 - (int)strlen(name));
+    fmt_mem(log, "R[10] <- ", 9);
+    fmt_hex(log, regs[REG_A0], 0, '0', 0);
+    fmt_char(log, '\n');
+}
+
+#if SIM_STATS
+static void count_classes(struct Stat* stats, long int id_counts[2][NUM_INSNS])
+{
+    for (int id = 1; id < NUM_INSNS; id++) {
+        long int not_jumped = id_counts[0][id];
+        long int jumped = id_counts[1][id];
+        long int n = not_jumped + jumped;
+        if (n == 0)
+            continue;
+        stats->mix[insn_info[id].base] += n;
+        switch (insn_info[id].base) {
+        case INSN_BEQ: case INSN_BNE: case INSN_BLT: case INSN_BGE: case INSN_BLTU: case INSN_BGEU:
+            stats->branches_taken += jumped;
+            stats->branches_not_taken += not_jumped;
+            break;
+        case INSN_JAL: stats->jal += n; break;
+        case INSN_JALR: stats->jalr += n; break;
+        case INSN_ECALL: stats->ecall += n; break;
+        case INSN_MUL: case INSN_MULH: case INSN_MULHSU: case INSN_MULHU:
+            stats->mul += n;
+            break;
+        case INSN_DIV: case INSN_DIVU: case INSN_REM: case INSN_REMU:
+            stats->div += n;
+            break;
+        case INSN_LB: case INSN_LBU: stats->loads += n; stats->bytes_loaded += n; break;
+        case INSN_LH: case INSN_LHU: stats->loads += n; stats->bytes_loaded += 2 * n; break;
+        case INSN_LW: stats->loads += n; stats->bytes_loaded += 4 * n; break;
+        case INSN_SB: stats->stores += n; stats->bytes_stored += n; break;
+        case INSN_SH: stats->stores += n; stats->bytes_stored += 2 * n; break;
+        case INSN_SW: stats->stores += n; stats->bytes_stored += 4 * n; break;
+        default: stats->alu += n; break;
+        }
+    }
+}
+#endif
+
+struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols, struct predecode* predecoded,
+                     struct console* console, struct syscalls* syscalls, struct intercepts* intercepts) {
+    struct hart hart;
+    hart_init(&hart, start_addr);
+    return simulate_hart(&hart, -1, mem, log_file, 0, NULL, NULL, symbols, predecoded, console, syscalls, intercepts);
+}
+
+void hart_init(struct hart* hart, uint32_t start_addr)
+{
+    memset(hart, 0, sizeof(*hart));
+    hart->pc = start_addr;
+}
+
+// the interpreter variants, from one source (see interpreter.inc)
+#define INTERP_NAME run_plain
+#define INTERP_LOG 0
+#define INTERP_STATS 0
+#define INTERP_PROFILE 0
+#define INTERP_BRANCHES 0
+#include "interpreter.inc"
+#undef INTERP_NAME
+#undef INTERP_LOG
+#undef INTERP_STATS
+#undef INTERP_PROFILE
+#undef INTERP_BRANCHES
+
+#define INTERP_NAME run_branches
+#define INTERP_LOG 0
+#define INTERP_STATS 0
+#define INTERP_PROFILE 0
+#define INTERP_BRANCHES 1
+#include "interpreter.inc"
+#undef INTERP_NAME
+#undef INTERP_LOG
+#undef INTERP_STATS
+#undef INTERP_PROFILE
+#undef INTERP_BRANCHES
+
+#if SIM_STATS
+#define INTERP_NAME run_stats
+#define INTERP_LOG 0
+#define INTERP_STATS 1
+#define INTERP_PROFILE 0
+#define INTERP_BRANCHES 0
+#include "interpreter.inc"
+#undef INTERP_NAME
+#undef INTERP_LOG
+#undef INTERP_STATS
+#undef INTERP_PROFILE
+#undef INTERP_BRANCHES
+#endif
+
+#define INTERP_NAME run_profile
+#define INTERP_LOG 0
+#define INTERP_STATS SIM_STATS
+#define INTERP_PROFILE 1
+#define INTERP_BRANCHES 0
+#include "interpreter.inc"
+#undef INTERP_NAME
+#undef INTERP_LOG
+#undef INTERP_STATS
+#undef INTERP_PROFILE
+#undef INTERP_BRANCHES
+
+#define INTERP_NAME run_log
+#define INTERP_LOG 1
+#define INTERP_STATS SIM_STATS
+#define INTERP_PROFILE 1
+#define INTERP_BRANCHES 0
+#include "interpreter.inc"
+#undef INTERP_NAME
+#undef INTERP_LOG
+#undef INTERP_STATS
+#undef INTERP_PROFILE
+#undef INTERP_BRANCHES
+
+struct Stat simulate_hart(struct hart* hart, long int max_insns, struct memory *mem, FILE *log_file, int collect_stats,
+                          struct profile* profile, struct bbv* bbv, struct symbols* symbols, struct predecode* predecoded,
+                          struct console* console, struct syscalls* syscalls, struct intercepts* intercepts) {
+    if (hart->halted) {
+        struct Stat none = { 0 };
+        return none;
+    }
+    struct predecode no_text = { 0 };
+    struct predecode* pd = predecoded ? predecoded : &no_text;
+    if (log_file)
+        return run_log(hart, max_insns, mem, log_file, profile, bbv, symbols, pd, console, syscalls, intercepts);
+    // the profile variant also counts the statistics
+    if (profile || bbv)
+        return run_profile(hart, max_insns, mem, log_file, profile, bbv, symbols, pd, console, syscalls, intercepts);
+#if SIM_STATS
+    if (collect_stats == STATS_ALL)
+        return run_stats(hart, max_insns, mem, log_file, profile, bbv, symbols, pd, console, syscalls, intercepts);
+#endif
+    if (collect_stats == STATS_BRANCHES)
+        return run_branches(hart, max_insns, mem, log_file, profile, bbv, symbols, pd, console, syscalls, intercepts);
+    return run_plain(hart, max_insns, mem, log_file, profile, bbv, symbols, pd, console, syscalls, intercepts);
+}
+
+void simulate_print_fault(FILE* out, const struct Stat* stats)
+{
+    switch (stats->fault) {
+    case SIM_FAULT_NONE:
+        break;
+    case SIM_FAULT_UNALIGNED:
+        fprintf(out, "Unaligned access to %x at %x\n", stats->fault_value, stats->fault_pc);
+        break;
+    case SIM_FAULT_OUT_OF_MEMORY:
+        fprintf(out, "Out of host memory for page at %x (at %x)\n", stats->fault_value, stats->fault_pc);
+        break;
+    case SIM_FAULT_ILLEGAL_INSN:
+        fprintf(out, "Unknown instruction %08x at %x\n", stats->fault_value, stats->fault_pc);
+        break;
+    case SIM_FAULT_UNKNOWN_SYSCALL:
+        fprintf(out, "Unknown system call %u at %x\n", stats->fault_value, stats->fault_pc);
+        break;
+    case SIM_FAULT_HOST_FUNCTION:
+        fprintf(out, "No host function for intercepted call at %x\n", stats->fault_pc);
+        break;
+    }
+}
+
+void simulate_add_stats(struct Stat* total, const struct Stat* run)
+{
+    struct Stat sum = *run;
+    sum.insns += total->insns;
+    sum.intercepted += total->intercepted;
+    sum.intercepted_insns += total->intercepted_insns;
+    sum.jumps += total->jumps;
+    sum.alu += total->alu;
+    sum.mul += total->mul;
+    sum.div += total->div;
+    sum.loads += total->loads;
+    sum.stores += total->stores;
+    sum.branches_taken += total->branches_taken;
+    sum.branches_not_taken += total->branches_not_taken;
+    sum.jal += total->jal;
+    sum.jalr += total->jalr;
+    sum.ecall += total->ecall;
+    sum.bytes_loaded += total->bytes_loaded;
+    sum.bytes_stored += total->bytes_stored;
+    for (int id = 0; id < NUM_BASE_INSNS; id++)
+        sum.mix[id] += total->mix[id];
+    *total = sum;
+}
+
+void simulate_print_stats(FILE* out, const struct Stat* stats)
+{
+#if SIM_STATS
+    const char* names[] = { "alu", "mul", "div", "load", "store", "branch taken", "branch not taken", "jal", "jalr", "ecall" };
+    long int counts[] = { stats->alu, stats->mul, stats->div, stats->loads, stats->stores, stats->branches_taken,
+                          stats->branches_not_taken, stats->jal, stats->jalr, stats->ecall };
+    fprintf(out, "\nInstruction classes           count        %%\n");
+    for (unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        fprintf(out, "    %-16s %14ld %7.2f%%\n", names[i], counts[i], stats->insns ? 100.0 * counts[i] / stats->insns : 0.0);
+    fprintf(out, "Bytes loaded %ld, stored %ld; %d pages of 64 KiB touched\n",
+            stats->bytes_loaded, stats->bytes_stored, stats->pages_touched);
+#else
+    (void)out;
+    (void)stats;
+#endif
+}
+
+struct mix_entry {
+    long int count;
+    int id;
+};
+
+static int compare_mix(const void* a, const void* b)
+{
+    const struct mix_entry* entry_a = a;
+    const struct mix_entry* entry_b = b;
+    if (entry_a->count != entry_b->count)
+        return entry_a->count < entry_b->count ? 1 : -1;
+    return entry_a->id - entry_b->id;
+}
+
+void simulate_print_mix(FILE* out, const struct Stat* stats)
+{
+    // most frequent first, ties in id order
+    struct mix_entry order[NUM_BASE_INSNS];
+    int num = 0;
+    for (int id = 1; id < NUM_BASE_INSNS; id++)
+        if (stats->mix[id])
+            order[num++] = (struct mix_entry){ stats->mix[id], id };
+    qsort(order, num, sizeof(order[0]), compare_mix);
+    fprintf(out, "\nInstruction mix          count        %%   cumul. %%\n");
+    long int cumulative = 0;
+    for (int i = 0; i < num; i++) {
+        long int count = order[i].count;
+        cumulative += count;
+        fprintf(out, "    %-8s %14ld %7.2f%% %8.2f%%", insn_info[order[i].id].mnemonic, count,
+                stats->insns ? 100.0 * count / stats->insns : 0.0, stats->insns ? 100.0 * cumulative / stats->insns : 0.0);
+        // a bar of up to 40 characters, relative to the most frequent instruction
+        int bar = (int)(40 * count / order[0].count);
+        if (bar)
+            fputs("  ", out);
+        for (int j = 0; j < bar; j++)
+            fputc('#', out);
+        fputc('\n', out);
     }
+    if (num == 0)
+        fprintf(out, "    (not counted)\n");
+}
@@ -3,11 +3,96 @@
 
 #include "memory.h"
 #include "read_elf.h"
+#include "predecode.h"
+#include "console.h"
+#include "syscalls.h"
+#include "intercept.h"
+#include "profile.h"
+#include "bbv.h"
+#include <stdint.h>
 #include <stdio.h>
 
 // Simuler RISC-V program i givet lager og fra given start adresse
-struct Stat { long int insns; };
+// Instruktioner i tekst-segmentet hentes fra den forhåndsafkodede tabel 'predecoded' (kan være NULL)
+// Programmets getchar/putchar går til 'console', systemkald udføres via tabellen 'syscalls'
+// Funktionerne i 'intercepts' (kan være NULL) udføres af værten og tælles i 'intercepted', ikke i 'insns';
+// 'intercepted_insns' er et skøn over de instruktioner, programmets egne versioner ville have udført
+// 'jumps' er antallet af hop og taget forgreninger
+// 'jumps', fordelingen på klasser og på instruktioner ('mix'), bytes læst/skrevet og berørte sider (á 64KB, se
+// memory_pages_touched) tælles kun på forlangende (se simulate_hart) og med SIM_STATS (se memory.h)
+// 'exit_code' er værdien programmet gav til exit
+// Stopper simuleringen på en fejl, er 'fault' en af SIM_FAULT_* og 'fault_pc' instruktionens
+// adresse; 'fault_value' er lageradressen, instruktionen eller systemkaldets nummer
+enum sim_fault {
+    SIM_FAULT_NONE,
+    SIM_FAULT_UNALIGNED,          // load/store på ulige adresse
+    SIM_FAULT_OUT_OF_MEMORY,      // værten kunne ikke allokere en side
+    SIM_FAULT_ILLEGAL_INSN,
+    SIM_FAULT_UNKNOWN_SYSCALL,
+    SIM_FAULT_HOST_FUNCTION       // ingen værtsfunktion til et markeret kald
+};
+struct Stat {
+    long int insns;
+    long int intercepted;
+    long int intercepted_insns;
+    long int jumps;
+    long int alu, mul, div, loads, stores;              // lui og auipc regnes med til alu
+    long int branches_taken, branches_not_taken;
+    long int jal, jalr, ecall;
+    long int bytes_loaded, bytes_stored;
+    long int mix[NUM_BASE_INSNS];                       // udført pr. instruktion (insn_info[id].base)
+    int pages_touched;
+    int exit_code;
+    int fault;
+    uint32_t fault_pc, fault_value;
+};
 
-struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols);
+struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols, struct predecode* predecoded,
+                     struct console* console, struct syscalls* syscalls, struct intercepts* intercepts);
+
+// Processorens tilstand, så en simulering kan stoppes og fortsættes
+struct hart {
+    uint32_t regs[32];
+    uint32_t pc;
+    int jumped;     // sidste instruktion var et hop (til loggen)
+    int halted;     // programmet har kaldt exit eller stoppet på en fejl
+};
+void hart_init(struct hart* hart, uint32_t start_addr);
+
+// hvad simulate_hart tæller ud over instruktionerne
+enum collect_stats {
+    STATS_NONE,
+    STATS_ALL,
+    STATS_BRANCHES
+};
+
+// Simuler højst 'max_insns' instruktioner (alle hvis negativ) fra tilstanden i 'hart',
+// som opdateres. Statistikken dækker kun dette kald; klasserne, 'jumps', bytes og sider
+// tælles kun med 'collect_stats' STATS_ALL eller 'log_file' (en langsommere variant af
+// fortolkeren). Med STATS_BRANCHES tælles kun forgreningerne (branches_taken/not_taken),
+// næsten lige så hurtigt som uden statistik.
+// Er 'profile' ikke NULL, tælles udførslerne af hver instruktion i tekst-segmentet der,
+// og er 'bbv' ikke NULL, tælles basis-blokkene der (se bbv.h)
+struct Stat simulate_hart(struct hart* hart, long int max_insns, struct memory *mem, FILE *log_file, int collect_stats,
+                          struct profile* profile, struct bbv* bbv,
+                          struct symbols* symbols, struct predecode* predecoded,
+                          struct console* console, struct syscalls* syscalls, struct intercepts* intercepts);
+
+// Et breakpoint er en instruktion i den forhåndsafkodede tekst markeret med INSN_BREAKPOINT.
+// simulate_hart stopper før instruktionen og lader 'halted' være 0; fjern mærket for at fortsætte
+#define INSN_BREAKPOINT (NUM_INSNS + 1)
+
+// skriv fejlen der stoppede simuleringen (hvis nogen) til 'out'
+void simulate_print_fault(FILE* out, const struct Stat* stats);
+
+// læg tællerne fra 'run' (et senere kald af simulate_hart) til 'total'; resten
+// (exit_code, fault, pages_touched) tages fra 'run'
+void simulate_add_stats(struct Stat* total, const struct Stat* run);
+
+// skriv fordelingen på klasser m.m. til 'out' (intet med SIM_STATS=0)
+void simulate_print_stats(FILE* out, const struct Stat* stats);
+
+// skriv 'mix' som histogram, hyppigste instruktion først
+void simulate_print_mix(FILE* out, const struct Stat* stats);
 
 #endif
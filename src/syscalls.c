@@ -0,0 +1,323 @@
+#include "syscalls.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// System call numbers and error codes as in newlib/Linux
+#define SYS_READ 63
+#define SYS_WRITE 64
+#define SYS_EXIT 93
+#define SYS_BRK 214
+#define SYS_MUNMAP 215
+#define SYS_MMAP 222
+#define GUEST_EBADF 9
+#define GUEST_ENOMEM 12
+#define GUEST_EINVAL 22
+#define GUEST_MAP_FIXED 0x10
+#define GUEST_MAP_ANONYMOUS 0x20
+
+// brk and mmap hand out memory in pages of this size
+#define HEAP_PAGE 0x1000
+
+// read and write move guest buffers through a host buffer of this size
+#define SYSCALL_BLOCK (1 << 16)
+
+static int sys_getchar(struct syscall_context* ctx)
+{
+    ctx->regs[REG_A0] = console_getchar(ctx->console);
+    return 1;
+}
+
+static int sys_putchar(struct syscall_context* ctx)
+{
+    console_putchar(ctx->console, ctx->regs[REG_A0]);
+    return 1;
+}
+
+static int sys_exit(struct syscall_context* ctx)
+{
+    ctx->exit_code = ctx->regs[REG_A0];
+    return 0;
+}
+
+// write(fd, buf, count): fd 1 goes to the console, fd 2 to the host's stderr
+static int sys_write(struct syscall_context* ctx)
+{
+    uint32_t fd = ctx->regs[REG_A0];
+    uint32_t buf = ctx->regs[REG_A1];
+    uint32_t count = ctx->regs[REG_A2];
+    if (fd != 1 && fd != 2) {
+        ctx->regs[REG_A0] = -GUEST_EBADF;
+        return 1;
+    }
+    if (fd == 2)
+        console_flush(ctx->console);
+    char block[SYSCALL_BLOCK];
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t chunk = count - done < SYSCALL_BLOCK ? count - done : SYSCALL_BLOCK;
+        memory_rd_block(ctx->mem, buf + done, block, chunk);
+        if (fd == 1) console_write(ctx->console, block, chunk);
+        else fwrite(block, 1, chunk, stderr);
+        done += chunk;
+    }
+    ctx->regs[REG_A0] = count;
+    return 1;
+}
+
+// read(fd, buf, count): fd 0 is the console. Like read(2) it may return
+// fewer bytes than asked for; 0 means end of input
+static int sys_read(struct syscall_context* ctx)
+{
+    uint32_t fd = ctx->regs[REG_A0];
+    uint32_t buf = ctx->regs[REG_A1];
+    uint32_t count = ctx->regs[REG_A2];
+    if (fd != 0) {
+        ctx->regs[REG_A0] = -GUEST_EBADF;
+        return 1;
+    }
+    char block[SYSCALL_BLOCK];
+    long got = console_read(ctx->console, block, count < SYSCALL_BLOCK ? count : SYSCALL_BLOCK);
+    memory_wr_block(ctx->mem, buf, block, got);
+    // input read into the text segment must be decoded again
+    predecode_update_range(ctx->pd, buf, got, ctx->mem);
+    ctx->regs[REG_A0] = got;
+    return 1;
+}
+
+static uint32_t round_to_page(uint32_t size)
+{
+    return (size + HEAP_PAGE - 1) & ~(uint32_t)(HEAP_PAGE - 1);
+}
+
+static void update_heap_peak(struct guest_heap* heap)
+{
+    uint32_t brk_bytes = heap->brk - heap->start;
+    if (brk_bytes > heap->peak_brk_bytes) heap->peak_brk_bytes = brk_bytes;
+    if (heap->mmap_bytes > heap->peak_mmap_bytes) heap->peak_mmap_bytes = heap->mmap_bytes;
+    if (brk_bytes + heap->mmap_bytes > heap->peak_bytes) heap->peak_bytes = brk_bytes + heap->mmap_bytes;
+}
+
+// brk(addr): move the break to addr if possible; returns the (new) break.
+// brk(0) asks for the current break.
+static int sys_brk(struct syscall_context* ctx)
+{
+    struct guest_heap* heap = ctx->heap;
+    uint32_t want = ctx->regs[REG_A0];
+    if (want >= heap->start && want <= heap->mmap_low) {
+        // memory above the new break reads as zero when it is handed out again
+        if (want < heap->brk)
+            memory_release(ctx->mem, want, heap->brk - want);
+        heap->brk = want;
+        update_heap_peak(heap);
+    }
+    ctx->regs[REG_A0] = heap->brk;
+    return 1;
+}
+
+// the lowest free range of 'size' bytes between or above the mappings, or
+// else just below them; 0 if there is none
+static uint32_t find_mmap_space(const struct guest_heap* heap, uint32_t size)
+{
+    for (uint32_t i = 0; i < heap->num_mappings; i++) {
+        uint32_t end = heap->mappings[i].start + heap->mappings[i].size;
+        uint32_t next = i + 1 < heap->num_mappings ? heap->mappings[i + 1].start : HEAP_MMAP_TOP;
+        if (next - end >= size)
+            return end;
+    }
+    return size <= heap->mmap_low - heap->brk ? heap->mmap_low - size : 0;
+}
+
+// add [start, start + size) to the mappings, which must not hold any of it;
+// returns 0 if that takes one mapping more than there is room for
+static int add_mapping(struct guest_heap* heap, uint32_t start, uint32_t size)
+{
+    struct heap_mapping* m = heap->mappings;
+    uint32_t i = 0;
+    while (i < heap->num_mappings && m[i].start < start)
+        i++;
+    int joins_below = i > 0 && m[i - 1].start + m[i - 1].size == start;
+    int joins_above = i < heap->num_mappings && start + size == m[i].start;
+    if (joins_below && joins_above) {
+        m[i - 1].size += size + m[i].size;
+        memmove(&m[i], &m[i + 1], (heap->num_mappings - i - 1) * sizeof(*m));
+        heap->num_mappings--;
+    } else if (joins_below) {
+        m[i - 1].size += size;
+    } else if (joins_above) {
+        m[i].start = start;
+        m[i].size += size;
+    } else {
+        if (heap->num_mappings == HEAP_MAX_MAPPINGS)
+            return 0;
+        memmove(&m[i + 1], &m[i], (heap->num_mappings - i) * sizeof(*m));
+        m[i] = (struct heap_mapping){ start, size };
+        heap->num_mappings++;
+    }
+    heap->mmap_low = m[0].start;
+    return 1;
+}
+
+// mmap(addr, length, prot, flags, fd, offset): anonymous mappings only; the
+// address hint, prot, fd and offset are ignored
+static int sys_mmap(struct syscall_context* ctx)
+{
+    struct guest_heap* heap = ctx->heap;
+    uint32_t length = ctx->regs[REG_A1];
+    uint32_t flags = ctx->regs[REG_A3];
+    uint32_t size = round_to_page(length);
+    uint32_t addr = size ? find_mmap_space(heap, size) : 0;
+    if (!(flags & GUEST_MAP_ANONYMOUS) || (flags & GUEST_MAP_FIXED) || length == 0) {
+        ctx->regs[REG_A0] = -GUEST_EINVAL;
+    } else if (addr == 0 || !add_mapping(heap, addr, size)) {
+        ctx->regs[REG_A0] = -GUEST_ENOMEM;
+    } else {
+        heap->mmap_bytes += size;
+        update_heap_peak(heap);
+        ctx->regs[REG_A0] = addr;
+    }
+    return 1;
+}
+
+// munmap(addr, length): unmaps the mapped pages in the range, if any
+static int sys_munmap(struct syscall_context* ctx)
+{
+    struct guest_heap* heap = ctx->heap;
+    struct heap_mapping* m = heap->mappings;
+    uint32_t addr = ctx->regs[REG_A0];
+    uint32_t size = round_to_page(ctx->regs[REG_A1]);
+    uint64_t end = (uint64_t)addr + size;
+    if ((addr & (HEAP_PAGE - 1)) || size == 0) {
+        ctx->regs[REG_A0] = -GUEST_EINVAL;
+        return 1;
+    }
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < heap->num_mappings; i++) {
+        uint32_t start = m[i].start;
+        uint64_t mapping_end = (uint64_t)start + m[i].size;
+        if (start < addr && mapping_end > end) {
+            // a hole in the middle splits the mapping in two
+            if (heap->num_mappings == HEAP_MAX_MAPPINGS) {
+                ctx->regs[REG_A0] = -GUEST_ENOMEM;
+                return 1;
+            }
+            memmove(&m[i + 2], &m[i + 1], (heap->num_mappings - i - 1) * sizeof(*m));
+            m[i].size = addr - start;
+            m[i + 1] = (struct heap_mapping){ (uint32_t)end, (uint32_t)(mapping_end - end) };
+            heap->num_mappings++;
+            memory_release(ctx->mem, addr, size);
+            heap->mmap_bytes -= size;
+            ctx->regs[REG_A0] = 0;
+            return 1;
+        }
+        uint64_t low = start > addr ? start : addr;
+        uint64_t high = mapping_end < end ? mapping_end : end;
+        if (low < high) {
+            // memory there reads as zero when it is handed out again
+            memory_release(ctx->mem, (uint32_t)low, (uint32_t)(high - low));
+            heap->mmap_bytes -= high - low;
+            if (low > start)
+                mapping_end = low;
+            else
+                start = high;
+            if (start == mapping_end)
+                continue;
+        }
+        m[kept++] = (struct heap_mapping){ start, (uint32_t)(mapping_end - start) };
+    }
+    heap->num_mappings = kept;
+    heap->mmap_low = kept ? m[0].start : HEAP_MMAP_TOP;
+    ctx->regs[REG_A0] = 0;
+    return 1;
+}
+
+struct syscalls* syscalls_create(int timed)
+{
+    struct syscalls* syscalls = calloc(1, sizeof(struct syscalls));
+    if (!syscalls) return NULL;
+    syscalls->timed = timed;
+    syscalls_init_heap(syscalls, 0);
+    syscalls_register(syscalls, 1, "getchar", sys_getchar, 1);
+    syscalls_register(syscalls, 2, "putchar", sys_putchar, 0);
+    syscalls_register(syscalls, 3, "exit", sys_exit, 0);
+    syscalls_register(syscalls, SYS_READ, "read", sys_read, 1);
+    syscalls_register(syscalls, SYS_WRITE, "write", sys_write, 1);
+    syscalls_register(syscalls, SYS_EXIT, "exit", sys_exit, 0);
+    syscalls_register(syscalls, SYS_BRK, "brk", sys_brk, 1);
+    syscalls_register(syscalls, SYS_MUNMAP, "munmap", sys_munmap, 1);
+    syscalls_register(syscalls, SYS_MMAP, "mmap", sys_mmap, 1);
+    return syscalls;
+}
+
+void syscalls_init_heap(struct syscalls* syscalls, uint32_t data_end)
+{
+    struct guest_heap* heap = &syscalls->heap;
+    uint32_t start = round_to_page(data_end);
+    heap->start = start > HEAP_BASE && start < HEAP_MMAP_TOP ? start : HEAP_BASE;
+    heap->brk = heap->start;
+    heap->mmap_low = HEAP_MMAP_TOP;
+    heap->mmap_bytes = 0;
+    heap->num_mappings = 0;
+    heap->peak_brk_bytes = 0;
+    heap->peak_mmap_bytes = 0;
+    heap->peak_bytes = 0;
+}
+
+void syscalls_delete(struct syscalls* syscalls)
+{
+    free(syscalls);
+}
+
+int syscalls_register(struct syscalls* syscalls, uint32_t number, const char* name,
+                      syscall_handler handler, int returns_value)
+{
+    if (number >= SYSCALL_MAX) return 0;
+    struct syscall_entry* entry = &syscalls->entries[number];
+    entry->name = name;
+    entry->handler = handler;
+    entry->returns_value = returns_value;
+    entry->count = 0;
+    entry->host_ns = 0;
+    return 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int syscalls_call(struct syscalls* syscalls, struct syscall_context* ctx)
+{
+    uint32_t number = ctx->regs[REG_A7];
+    struct syscall_entry* entry = syscalls_lookup(syscalls, number);
+    if (!entry)
+        return -1;
+    entry->count++;
+    if (!syscalls->timed)
+        return entry->handler(ctx);
+    uint64_t start = now_ns();
+    int running = entry->handler(ctx);
+    entry->host_ns += now_ns() - start;
+    return running;
+}
+
+void syscalls_print_summary(struct syscalls* syscalls, FILE* out)
+{
+    int header = 0;
+    for (uint32_t number = 0; number < SYSCALL_MAX; number++) {
+        struct syscall_entry* entry = &syscalls->entries[number];
+        if (!entry->count) continue;
+        if (!header) {
+            fprintf(out, "\nSystem calls%s\n", syscalls->timed ? "             calls   host time" : "             calls");
+            header = 1;
+        }
+        fprintf(out, "  %3u %-10s %12ld", number, entry->name, entry->count);
+        if (syscalls->timed)
+            fprintf(out, "  %9.6f s", entry->host_ns * 1e-9);
+        fprintf(out, "\n");
+    }
+    struct guest_heap* heap = &syscalls->heap;
+    fprintf(out, "\nGuest heap peak: %u KiB (brk %u KiB, mmap %u KiB)\n",
+            heap->peak_bytes >> 10, heap->peak_brk_bytes >> 10, heap->peak_mmap_bytes >> 10);
+}
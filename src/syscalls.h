@@ -0,0 +1,107 @@
+#ifndef __SYSCALLS_H__
+#define __SYSCALLS_H__
+
+#include "memory.h"
+#include "predecode.h"
+#include "console.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// System calls of the simulated program. ecall looks up the number in a7 in
+// a table of host handlers; simulate() itself knows nothing about the
+// individual calls, so new host services are added by registering a handler.
+
+// Register numbers used by the system call interface
+#define REG_A0 10
+#define REG_A1 11
+#define REG_A2 12
+#define REG_A3 13
+#define REG_A7 17
+
+// System call numbers above this are unknown
+#define SYSCALL_MAX 512
+
+// The guest heap. brk grows up from 'start', anonymous mmap regions are
+// handed out downwards from HEAP_MMAP_TOP, or in a hole munmap left if one is
+// large enough. Neither costs host memory until the program writes to it
+// (memory.c allocates pages on the first write), and shrinking brk or munmap
+// gives the pages back. munmap of pages that are not mapped does nothing.
+#define HEAP_BASE 0x10000000      // above the stack and heap the course runtime uses
+#define HEAP_MMAP_TOP 0xc0000000
+#define HEAP_MAX_MAPPINGS 256     // separate mapped ranges; mmap fails beyond that
+
+struct heap_mapping {
+    uint32_t start;
+    uint32_t size;
+};
+
+struct guest_heap {
+    uint32_t start;           // the initial break
+    uint32_t brk;
+    uint32_t mmap_low;        // lowest mapped address, HEAP_MMAP_TOP if none
+    uint32_t mmap_bytes;      // currently mapped
+    uint32_t peak_brk_bytes;
+    uint32_t peak_mmap_bytes;
+    uint32_t peak_bytes;      // brk and mmap together
+    uint32_t num_mappings;
+    struct heap_mapping mappings[HEAP_MAX_MAPPINGS];  // sorted by address, adjacent ones merged
+};
+
+// What a handler can see and change. regs are the simulated registers,
+// arguments come in a0..a6 and the result goes in a0.
+struct syscall_context {
+    uint32_t* regs;
+    uint32_t pc;
+    struct memory* mem;
+    struct predecode* pd;   // stores into the text segment must update it
+    struct console* console;
+    struct guest_heap* heap;
+    int exit_code;          // set by exit
+    uint32_t bytes;         // bytes the host version of an intercepted function worked on (see intercept.h)
+};
+
+// returns 1 to go on, 0 to stop the simulation
+typedef int (*syscall_handler)(struct syscall_context* ctx);
+
+struct syscall_entry {
+    const char* name;       // NULL for unused numbers
+    syscall_handler handler;
+    int returns_value;      // the handler writes a0 (shown in the execution log)
+    long count;
+    uint64_t host_ns;       // host time spent in the handler, if timed
+};
+
+struct syscalls {
+    int timed;              // measure host time per call
+    struct guest_heap heap;
+    struct syscall_entry entries[SYSCALL_MAX];
+};
+
+// a table with the standard system calls (getchar, putchar, exit, read,
+// write, brk, mmap, munmap)
+struct syscalls* syscalls_create(int timed);
+void syscalls_delete(struct syscalls* syscalls);
+
+// start the heap above data_end (the end of the loaded program) instead of at HEAP_BASE
+void syscalls_init_heap(struct syscalls* syscalls, uint32_t data_end);
+
+// install (or replace) the handler for 'number'; returns 0 if number is out of range
+int syscalls_register(struct syscalls* syscalls, uint32_t number, const char* name,
+                      syscall_handler handler, int returns_value);
+
+// the entry for 'number', or NULL if there is no handler
+static inline struct syscall_entry* syscalls_lookup(struct syscalls* syscalls, uint32_t number)
+{
+    if (number >= SYSCALL_MAX || !syscalls->entries[number].handler)
+        return NULL;
+    return &syscalls->entries[number];
+}
+
+// perform the system call in a7; returns 0 if the simulation should stop,
+// -1 if there is no handler for it
+int syscalls_call(struct syscalls* syscalls, struct syscall_context* ctx);
+
+// calls, counts and host time of every system call used and the peak heap, for the summary
+void syscalls_print_summary(struct syscalls* syscalls, FILE* out);
+
+#endif
@@ -0,0 +1,53 @@
+// isacheck: run the test vectors tools/isagen made from rv32im.isa through
+// decode() and the disassembler
+//
+//   make check
+//
+// Prints every vector that decodes or disassembles differently from what the
+// description says, and exits with 1 if there were any.
+
+#include "../decode.h"
+#include "../disassemble.h"
+#include <stdio.h>
+#include <string.h>
+
+struct isa_vector {
+    uint32_t word;
+    int id;            // enum insn_id
+    uint32_t rd;
+    uint32_t rs1;
+    uint32_t rs2;
+    int32_t imm;
+    const char* text;  // disassembled at VECTOR_ADDR
+};
+
+#include "../isa_vectors.inc"
+
+#define NUM_VECTORS (int)(sizeof(isa_vectors) / sizeof(isa_vectors[0]))
+
+static const char* id_name(int id)
+{
+    return id == INSN_INVALID ? "invalid" : insn_info[id].mnemonic;
+}
+
+int main(void)
+{
+    int failed = 0;
+    for (int i = 0; i < NUM_VECTORS; i++) {
+        const struct isa_vector* v = &isa_vectors[i];
+        struct insn insn;
+        decode(v->word, &insn);
+        char text[128];
+        disassemble(VECTOR_ADDR, v->word, text, sizeof(text), NULL);
+        int ok = insn.id == v->id && insn.rd == v->rd && insn.rs1 == v->rs1 && insn.rs2 == v->rs2
+              && insn.imm == v->imm && !strcmp(text, v->text);
+        if (ok) continue;
+        failed++;
+        printf("0x%08x: expected %s (id %d) rd %u rs1 %u rs2 %u imm %d \"%s\"\n", v->word, id_name(v->id), v->id,
+               v->rd, v->rs1, v->rs2, v->imm, v->text);
+        printf("            got %s (id %d) rd %u rs1 %u rs2 %u imm %d \"%s\"\n", id_name(insn.id), insn.id,
+               insn.rd, insn.rs1, insn.rs2, insn.imm, text);
+    }
+    printf("isacheck: %d vectors, %d failed\n", NUM_VECTORS, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,363 @@
+// isagen: generate decoder tables and interpreter handlers from an ISA description
+//
+//   isagen rv32im.isa
+//
+// writes into the current directory:
+//   isa_gen.h       enum insn_id
+//   isa_tables.inc  insn_info[] and decode_table[] (included by decode.c)
+//   isa_exec.inc    one case per instruction id (included by simulate.c)
+//   isa_vectors.inc test vectors for decode() and the disassembler (included by
+//                   tools/isacheck.c, run by 'make check')
+//
+// Every instruction that assigns RD gets a second id, used when rd is x0. Its
+// handler evaluates the right hand side but discards the result, so the
+// interpreter never has to check for writes to x0 at run time.
+//
+// The test vectors are encoded here from the format alone, independently of
+// decode.h: a few register and immediate combinations per instruction (with
+// the extremes of each immediate, and rd == x0 where that makes a variant),
+// plus for each instruction a word with one of its fixed bits flipped that no
+// instruction matches, which must decode as unknown.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INSNS 250
+#define MAX_LINE 1024
+
+// must match decode_key() in decode.h: opcode[6:2], funct3, bit 25, bit 30, rd == x0
+#define KEY_BITS 11
+#define KEY_MASK 0x4200707cu
+
+struct insn_desc {
+    char mnemonic[32];
+    char name[32];        // upper case mnemonic
+    char format[16];
+    uint32_t mask;
+    uint32_t match;
+    char semantics[MAX_LINE];
+    int writes_rd;
+    int id;
+    int x0_id;
+};
+
+// address the vectors are disassembled at, so branch and jump targets are absolute
+#define VECTOR_ADDR 0x00010000u
+
+static struct insn_desc insns[MAX_INSNS];
+static int num_insns;
+
+static uint32_t key_word(uint32_t key)
+{
+    uint32_t word = ((key & 0x1f) << 2) | (((key >> 5) & 7) << 12)
+                  | (((key >> 8) & 1) << 25) | (((key >> 9) & 1) << 30);
+    if (!((key >> 10) & 1))
+        word |= 1 << 7;   // some non-zero rd
+    return word;
+}
+
+static int is_ident_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// position of the identifier 'name' in s, or NULL
+static const char* find_ident(const char* s, const char* name)
+{
+    size_t len = strlen(name);
+    for (const char* p = strstr(s, name); p; p = strstr(p + 1, name)) {
+        if ((p == s || !is_ident_char(p[-1])) && !is_ident_char(p[len]))
+            return p;
+    }
+    return NULL;
+}
+
+// position of "RD =" in s (an assignment, not a comparison), or NULL
+static const char* find_rd_assignment(const char* s, const char** rhs)
+{
+    for (const char* p = find_ident(s, "RD"); p; p = find_ident(p + 2, "RD")) {
+        const char* q = p + 2;
+        while (*q == ' ') q++;
+        if (q[0] == '=' && q[1] != '=') {
+            q++;
+            while (*q == ' ') q++;
+            *rhs = q;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// semantics with every "RD = expr;" replaced by "(void)(expr);"
+static void emit_discarding_rd(FILE* out, const char* s)
+{
+    const char* rhs;
+    const char* p;
+    while ((p = find_rd_assignment(s, &rhs)) != NULL) {
+        fwrite(s, 1, p - s, out);
+        int depth = 0;
+        const char* end = rhs;
+        while (*end && !(*end == ';' && depth == 0)) {
+            if (*end == '(') depth++;
+            if (*end == ')') depth--;
+            end++;
+        }
+        fputs("(void)(", out);
+        fwrite(rhs, 1, end - rhs, out);
+        fputs(")", out);
+        s = end;
+    }
+    fputs(s, out);
+}
+
+static void parse(const char* file_name)
+{
+    FILE* file = fopen(file_name, "r");
+    if (!file) {
+        perror(file_name);
+        exit(1);
+    }
+    char line[MAX_LINE];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = 0;
+        char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == 0 || *p == '#') continue;
+        if (num_insns == MAX_INSNS) {
+            fprintf(stderr, "%s:%d: too many instructions\n", file_name, line_number);
+            exit(1);
+        }
+        struct insn_desc* insn = &insns[num_insns];
+        int consumed = 0;
+        if (sscanf(p, "%31s %15s %x %x %n", insn->mnemonic, insn->format, &insn->mask, &insn->match, &consumed) != 4
+            || p[consumed] == 0) {
+            fprintf(stderr, "%s:%d: expected 'mnemonic format mask match semantics'\n", file_name, line_number);
+            exit(1);
+        }
+        if ((insn->match & ~insn->mask) != 0) {
+            fprintf(stderr, "%s:%d: match has bits outside of mask\n", file_name, line_number);
+            exit(1);
+        }
+        strcpy(insn->semantics, p + consumed);
+        for (int i = 0; insn->mnemonic[i]; i++)
+            insn->name[i] = toupper((unsigned char)insn->mnemonic[i]);
+        const char* rhs;
+        insn->writes_rd = find_rd_assignment(insn->semantics, &rhs) != NULL;
+        num_insns++;
+    }
+    fclose(file);
+}
+
+static int has_format(const struct insn_desc* insn, const char* format)
+{
+    return !strcmp(insn->format, format);
+}
+
+// the instruction word with the given operands placed as the format says
+static uint32_t encode(const struct insn_desc* insn, uint32_t rd, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    uint32_t word = insn->match;
+    uint32_t u = (uint32_t)imm;
+    if (has_format(insn, "R"))
+        word |= rd << 7 | rs1 << 15 | rs2 << 20;
+    else if (has_format(insn, "I") || has_format(insn, "LOAD"))
+        word |= rd << 7 | rs1 << 15 | u << 20;
+    else if (has_format(insn, "SHIFT"))
+        word |= rd << 7 | rs1 << 15 | (u & 0x1f) << 20;
+    else if (has_format(insn, "S"))
+        word |= (u & 0x1f) << 7 | rs1 << 15 | rs2 << 20 | (u >> 5) << 25;
+    else if (has_format(insn, "B"))
+        word |= ((u >> 11) & 1) << 7 | ((u >> 1) & 0xf) << 8 | rs1 << 15 | rs2 << 20
+              | ((u >> 5) & 0x3f) << 25 | ((u >> 12) & 1) << 31;
+    else if (has_format(insn, "U"))
+        word |= rd << 7 | (u & 0xfffff000);
+    else if (has_format(insn, "J"))
+        word |= rd << 7 | ((u >> 12) & 0xff) << 12 | ((u >> 11) & 1) << 20
+              | ((u >> 1) & 0x3ff) << 21 | ((u >> 20) & 1) << 31;
+    return word;
+}
+
+// the disassembler's text for the operands
+static void expected_text(char* text, size_t size, const struct insn_desc* insn,
+                          uint32_t rd, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    char m[sizeof(insn->mnemonic)];
+    strcpy(m, insn->mnemonic);
+    if (has_format(insn, "R"))
+        snprintf(text, size, "%s x%u, x%u, x%u", m, rd, rs1, rs2);
+    else if (has_format(insn, "I") || has_format(insn, "SHIFT"))
+        snprintf(text, size, "%s x%u, x%u, %d", m, rd, rs1, imm);
+    else if (has_format(insn, "LOAD"))
+        snprintf(text, size, "%s x%u, %d(x%u)", m, rd, imm, rs1);
+    else if (has_format(insn, "S"))
+        snprintf(text, size, "%s x%u, %d(x%u)", m, rs2, imm, rs1);
+    else if (has_format(insn, "B"))
+        snprintf(text, size, "%s x%u, x%u, 0x%x", m, rs1, rs2, VECTOR_ADDR + (uint32_t)imm);
+    else if (has_format(insn, "U"))
+        snprintf(text, size, "%s x%u, 0x%x", m, rd, (uint32_t)imm);
+    else if (has_format(insn, "J"))
+        snprintf(text, size, "%s x%u, 0x%x", m, rd, VECTOR_ADDR + (uint32_t)imm);
+    else
+        snprintf(text, size, "%s", m);
+}
+
+static int matches_any(uint32_t word)
+{
+    for (int i = 0; i < num_insns; i++) {
+        if ((word & insns[i].mask) == insns[i].match)
+            return 1;
+    }
+    return 0;
+}
+
+// { word, id, rd, rs1, rs2, imm, disassembly } per vector
+static void emit_vectors(FILE* out)
+{
+    // registers: a plain case, the highest numbers, and rd == x0
+    static const uint32_t regs[][3] = { { 1, 2, 3 }, { 31, 30, 29 }, { 0, 5, 6 } };
+    // immediates: the smallest, the largest and a small negative one
+    static const struct { const char* format; int32_t imm[3]; } imms[] = {
+        { "I", { -2048, 2047, -5 } },
+        { "LOAD", { -2048, 2047, -5 } },
+        { "SHIFT", { 0, 31, 7 } },
+        { "S", { -2048, 2047, -5 } },
+        { "B", { -4096, 4094, -8 } },
+        { "U", { (int32_t)0xfffff000u, 0x7ffff000, 0x12345000 } },
+        { "J", { -1048576, 1048574, -2048 } },
+    };
+    for (int i = 0; i < num_insns; i++) {
+        const struct insn_desc* insn = &insns[i];
+        int cases = has_format(insn, "SYS") ? 1 : 3;
+        for (int c = 0; c < cases; c++) {
+            uint32_t rd = regs[c][0], rs1 = regs[c][1], rs2 = regs[c][2];
+            int32_t imm = 0;
+            for (size_t f = 0; f < sizeof(imms) / sizeof(imms[0]); f++) {
+                if (has_format(insn, imms[f].format))
+                    imm = imms[f].imm[c];
+            }
+            if (has_format(insn, "SYS"))
+                rd = rs1 = rs2 = 0;
+            uint32_t word = encode(insn, rd, rs1, rs2, imm);
+            char text[128];
+            expected_text(text, sizeof(text), insn, rd, rs1, rs2, imm);
+            // decode() takes the register fields from their places whatever the format
+            int x0 = insn->writes_rd && ((word >> 7) & 0x1f) == 0;
+            fprintf(out, "    { 0x%08x, INSN_%s%s, %u, %u, %u, %d, \"%s\" },\n", word, insn->name, x0 ? "_X0" : "",
+                    (word >> 7) & 0x1f, (word >> 15) & 0x1f, (word >> 20) & 0x1f, imm, text);
+        }
+        // the lowest fixed bit that does not select the decode table entry
+        uint32_t word = encode(insn, 1, 2, 3, 0);
+        uint32_t bits = insn->mask & ~KEY_MASK & ~0x3u;
+        for (uint32_t bit = 1; bit; bit <<= 1) {
+            if (!(bits & bit) || matches_any(word ^ bit)) continue;
+            word ^= bit;
+            fprintf(out, "    { 0x%08x, INSN_INVALID, %u, %u, %u, 0, \"Unknown instruction (0x%08x)\" },\n", word,
+                    (word >> 7) & 0x1f, (word >> 15) & 0x1f, (word >> 20) & 0x1f, word);
+            break;
+        }
+    }
+}
+
+static FILE* create(const char* file_name)
+{
+    FILE* file = fopen(file_name, "w");
+    if (!file) {
+        perror(file_name);
+        exit(1);
+    }
+    fprintf(file, "// Generated by tools/isagen - do not edit\n\n");
+    return file;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: isagen description.isa\n");
+        return 1;
+    }
+    parse(argv[1]);
+
+    // ids: INSN_INVALID, the instructions, then the rd == x0 variants
+    int next_id = 1;
+    for (int i = 0; i < num_insns; i++)
+        insns[i].id = next_id++;
+    for (int i = 0; i < num_insns; i++)
+        insns[i].x0_id = insns[i].writes_rd ? next_id++ : insns[i].id;
+    if (next_id > 256) {
+        fprintf(stderr, "isagen: more than 255 instruction ids\n");
+        return 1;
+    }
+
+    FILE* out = create("isa_gen.h");
+    fprintf(out, "#ifndef __ISA_GEN_H__\n#define __ISA_GEN_H__\n\n");
+    fprintf(out, "#define DECODE_KEY_BITS %d\n\n", KEY_BITS);
+    fprintf(out, "enum insn_id {\n    INSN_INVALID = 0,\n");
+    for (int i = 0; i < num_insns; i++)
+        fprintf(out, "    INSN_%s = %d,\n", insns[i].name, insns[i].id);
+    for (int i = 0; i < num_insns; i++) {
+        if (insns[i].writes_rd)
+            fprintf(out, "    INSN_%s_X0 = %d,\n", insns[i].name, insns[i].x0_id);
+    }
+    fprintf(out, "    NUM_INSNS = %d\n};\n\n", next_id);
+    fprintf(out, "// ids below this are the instructions themselves, the rest are rd == x0 variants\n");
+    fprintf(out, "#define NUM_BASE_INSNS %d\n\n#endif\n", num_insns + 1);
+    fclose(out);
+
+    out = create("isa_tables.inc");
+    fprintf(out, "const struct insn_info insn_info[NUM_INSNS] = {\n");
+    fprintf(out, "    [INSN_INVALID] = { \"unknown\", FMT_NONE, 0x00000000, 0x00000000, INSN_INVALID },\n");
+    for (int i = 0; i < num_insns; i++)
+        fprintf(out, "    [INSN_%s] = { \"%s\", FMT_%s, 0x%08x, 0x%08x, INSN_%s },\n", insns[i].name,
+                insns[i].mnemonic, insns[i].format, insns[i].mask, insns[i].match, insns[i].name);
+    for (int i = 0; i < num_insns; i++) {
+        if (insns[i].writes_rd)
+            fprintf(out, "    [INSN_%s_X0] = { \"%s\", FMT_%s, 0x%08x, 0x%08x, INSN_%s },\n", insns[i].name,
+                    insns[i].mnemonic, insns[i].format, insns[i].mask, insns[i].match, insns[i].name);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const uint8_t decode_table[1 << DECODE_KEY_BITS] = {");
+    for (uint32_t key = 0; key < (1u << KEY_BITS); key++) {
+        uint32_t word = key_word(key);
+        int found = -1;
+        for (int i = 0; i < num_insns; i++) {
+            if ((word & insns[i].mask & KEY_MASK) != (insns[i].match & KEY_MASK)) continue;
+            if (found >= 0) {
+                fprintf(stderr, "isagen: %s and %s can not be told apart by the decode key\n",
+                        insns[found].mnemonic, insns[i].mnemonic);
+                return 1;
+            }
+            found = i;
+        }
+        int id = 0;
+        if (found >= 0)
+            id = (key >> 10) & 1 ? insns[found].x0_id : insns[found].id;
+        fprintf(out, "%s%3d,", key % 16 ? " " : "\n    ", id);
+    }
+    fprintf(out, "\n};\n");
+    fclose(out);
+
+    out = create("isa_exec.inc");
+    for (int i = 0; i < num_insns; i++)
+        fprintf(out, "case INSN_%s: %s break;\n", insns[i].name, insns[i].semantics);
+    for (int i = 0; i < num_insns; i++) {
+        if (!insns[i].writes_rd) continue;
+        fprintf(out, "case INSN_%s_X0: ", insns[i].name);
+        emit_discarding_rd(out, insns[i].semantics);
+        fprintf(out, " break;\n");
+    }
+    fclose(out);
+
+    out = create("isa_vectors.inc");
+    fprintf(out, "#define VECTOR_ADDR 0x%08x\n\n", VECTOR_ADDR);
+    fprintf(out, "static const struct isa_vector isa_vectors[] = {\n");
+    emit_vectors(out);
+    fprintf(out, "};\n");
+    fclose(out);
+    return 0;
+}
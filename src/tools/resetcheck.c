@@ -0,0 +1,80 @@
+// resetcheck: run a program that copies stdin to stdout (bench/echo.riscv)
+// part of the way, reset it and run it to the end, twice, and check that each
+// complete run gave exactly its input as output
+//
+//   make check
+//
+// Output the first run left in the console, or input it had already read,
+// would show up in the next run after sim_reset. Both together would give the
+// input again, so the output must also be empty right after the reset.
+
+#include "../libsim.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INPUT_LINES 2000
+
+static int check_run(struct sim* sim, const char* input, size_t input_len, const char* what)
+{
+    size_t len;
+    sim_output(sim, &len);
+    if (len != 0) {
+        printf("resetcheck: %s: %zu bytes of output from before the reset\n", what, len);
+        return 1;
+    }
+    int status = sim_run(sim, -1);
+    const char* output = sim_output(sim, &len);
+    if (status != SIM_EXITED || len != input_len || memcmp(output, input, len)) {
+        printf("resetcheck: %s: status %d, %zu bytes of output for %zu bytes of input\n", what, status, len, input_len);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: resetcheck echo.riscv\n");
+        return 1;
+    }
+    // enough input that the first run stops in the middle of it
+    static char input[INPUT_LINES * 32];
+    size_t input_len = 0;
+    for (int i = 0; i < INPUT_LINES; i++)
+        input_len += sprintf(input + input_len, "line %d of the input\n", i);
+    FILE* in = tmpfile();
+    if (!in || fwrite(input, 1, input_len, in) != input_len || fflush(in) || lseek(fileno(in), 0, SEEK_SET)) {
+        perror("resetcheck");
+        return 1;
+    }
+
+    struct sim_options options;
+    sim_default_options(&options);
+    options.in_fd = fileno(in);
+    options.out_fd = -1;
+    struct sim* sim = sim_create(&options);
+    char* args[] = { "--" };
+    if (!sim || sim_load(sim, argv[1], 1, args) != SIM_OK) {
+        fprintf(stderr, "resetcheck: could not load %s\n", argv[1]);
+        return 1;
+    }
+    int failed = 0;
+    if (sim_run(sim, 1000) != SIM_STOPPED) {
+        printf("resetcheck: the first run did not stop part of the way\n");
+        failed = 1;
+    }
+    // the first reset loads the program again, the second restores the snapshot
+    for (int i = 0; i < 2 && !failed; i++) {
+        if (sim_reset(sim) != SIM_OK) {
+            printf("resetcheck: sim_reset failed\n");
+            failed = 1;
+            break;
+        }
+        failed = check_run(sim, input, input_len, i == 0 ? "run after the first reset" : "run after the second reset");
+    }
+    sim_destroy(sim);
+    fclose(in);
+    printf("resetcheck: %s\n", failed ? "failed" : "ok");
+    return failed;
+}
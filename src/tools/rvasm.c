@@ -0,0 +1,931 @@
+// rvasm: a small RV32IM assembler, for test and benchmark programs on hosts
+// without a RISC-V cross toolchain
+//
+//   rvasm prog.s [-o prog.riscv] [-t text address]
+//
+// The instructions are written the way the disassembler prints them
+// ("addi x2, x2, -16", "lw x1, 12(x2)", "beq x5, x6, loop"), with these
+// additions:
+//
+//   label:              a symbol for the current address
+//   .text / .data / .bss   the section that follows; data gets its own segment after
+//                       the text, and bss (zeroes only, not in the file) follows the data
+//   .globl name         make a symbol global (sim looks up global symbols only)
+//   .word v, ...        32 bit values, numbers or symbols
+//   .half v, ... / .byte v, ...
+//   .zero n             n zero bytes
+//   .ascii "s" / .asciz "s"   with \n \t \r \0 \\ and \" escapes
+//   .align n            align to 2^n bytes
+//   .equ name, v / .set name, v   a constant; v may use numbers and earlier constants
+//   nop, mv rd, rs, li rd, value, la rd, symbol, j target, call target, ret,
+//   beqz/bnez/blez/bgez/bltz/bgtz rs, target, bgt/ble/bgtu/bleu rs, rt, target
+//
+// Registers are x0..x31 or their ABI names. Values are C numbers and symbols,
+// combined with + - * / % << >> and parentheses, or %hi(value) or %lo(value). lui and auipc take
+// the value as the disassembler prints it, with the low 12 bits zero (so
+// "lui x5, %hi(buffer)" and "addi x5, x5, %lo(buffer)" go together), and
+// branch and jump targets are addresses, not offsets. Comments start with '#'.
+//
+// The program starts at _start, or else at the first instruction. The ELF
+// file has the symbol table, so -d, -l and --checkpoint-at can use the labels.
+
+#include "../elf.h"
+#include "../decode.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 1024
+#define MAX_OPERANDS 8
+#define DEFAULT_TEXT 0x10000      // where the text segment (with the ELF headers) is loaded
+#define SEGMENT_ALIGN 0x1000
+
+enum section { TEXT, DATA, BSS, NUM_SECTION_KINDS };
+
+struct symbol {
+    char* name;
+    int section;
+    uint32_t offset;      // in the section; the value itself for a constant
+    int global;
+    int defined;
+    int constant;         // from .equ/.set, not in the ELF symbol table
+    int line;             // where the constant is defined
+};
+
+struct buffer {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+};
+
+static const char* file_name;
+static int line_number;
+static int pass;
+
+static struct symbol* symbols;
+static int num_symbols;
+static int cap_symbols;
+static int* symbol_hash;          // indexes into symbols, -1 for free slots
+static int hash_size;
+
+static struct buffer sections[NUM_SECTION_KINDS];   // bss only counts its length
+static uint32_t section_size[NUM_SECTION_KINDS];    // sizes found in the first pass
+static uint32_t section_base[NUM_SECTION_KINDS];
+static int section;
+
+static void error(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", file_name, line_number);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    exit(1);
+}
+
+static void* grow(void* data, size_t size)
+{
+    void* grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "rvasm: out of memory\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static void put_bytes(struct buffer* buffer, const void* data, size_t len)
+{
+    if (buffer->len + len > buffer->cap) {
+        buffer->cap = (buffer->len + len) * 2 + 256;
+        buffer->data = grow(buffer->data, buffer->cap);
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+static void put_word(struct buffer* buffer, uint32_t word)
+{
+    unsigned char bytes[4] = { word, word >> 8, word >> 16, word >> 24 };
+    put_bytes(buffer, bytes, 4);
+}
+
+// ---- symbols
+
+static uint32_t hash(const char* name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+// the hash slot of 'name': its symbol or a free slot
+static int* hash_slot(const char* name)
+{
+    uint32_t i = hash(name) & (hash_size - 1);
+    while (symbol_hash[i] >= 0 && strcmp(symbols[symbol_hash[i]].name, name))
+        i = (i + 1) & (hash_size - 1);
+    return &symbol_hash[i];
+}
+
+static struct symbol* find_symbol(const char* name)
+{
+    if (!hash_size)
+        return NULL;
+    int index = *hash_slot(name);
+    return index >= 0 ? &symbols[index] : NULL;
+}
+
+static struct symbol* add_symbol(const char* name)
+{
+    struct symbol* symbol = find_symbol(name);
+    if (symbol)
+        return symbol;
+    if (num_symbols == cap_symbols) {
+        cap_symbols = cap_symbols ? 2 * cap_symbols : 64;
+        symbols = grow(symbols, cap_symbols * sizeof(struct symbol));
+        // the table stays at most half full
+        free(symbol_hash);
+        hash_size = 2 * cap_symbols;
+        symbol_hash = grow(NULL, hash_size * sizeof(int));
+        memset(symbol_hash, -1, hash_size * sizeof(int));
+        for (int i = 0; i < num_symbols; i++)
+            *hash_slot(symbols[i].name) = i;
+    }
+    symbol = &symbols[num_symbols];
+    memset(symbol, 0, sizeof(*symbol));
+    symbol->name = strdup(name);
+    *hash_slot(name) = num_symbols++;
+    return symbol;
+}
+
+static uint32_t symbol_value(const struct symbol* symbol)
+{
+    return symbol->constant ? symbol->offset : section_base[symbol->section] + symbol->offset;
+}
+
+// the current address
+static uint32_t here(void)
+{
+    return section_base[section] + (pass == 1 ? section_size[section] : sections[section].len);
+}
+
+static void advance(uint32_t bytes)
+{
+    if (pass == 1)
+        section_size[section] += bytes;
+}
+
+// ---- operands
+
+static char* trim(char* s)
+{
+    while (isspace((unsigned char)*s)) s++;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = 0;
+    return s;
+}
+
+static int is_symbol_start(char c)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '.';
+}
+
+static int is_symbol_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static const char* abi_names[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+static int parse_register(const char* s)
+{
+    if (s[0] == 'x' && isdigit((unsigned char)s[1])) {
+        char* end;
+        long n = strtol(s + 1, &end, 10);
+        if (*end == 0 && n >= 0 && n < 32)
+            return n;
+    }
+    if (!strcmp(s, "fp"))
+        return 8;
+    for (int i = 0; i < 32; i++)
+        if (!strcmp(s, abi_names[i]))
+            return i;
+    error("'%s' is not a register", s);
+    return 0;
+}
+
+// An expression over numbers and symbols, for parse_value. Symbols that are
+// not defined yet count as 0 in the first pass; sizes never depend on them.
+// Constants defined further up are known in the first pass and count as numbers
+struct expression {
+    const char* p;
+    const char* text;     // all of it, for error messages
+    int* uses_symbol;
+};
+
+static void skip_spaces(struct expression* e)
+{
+    while (isspace((unsigned char)*e->p)) e->p++;
+}
+
+static int64_t parse_sum(struct expression* e);
+
+static int64_t parse_factor(struct expression* e)
+{
+    skip_spaces(e);
+    if (*e->p == '(') {
+        e->p++;
+        int64_t value = parse_sum(e);
+        skip_spaces(e);
+        if (*e->p++ != ')')
+            error("missing ')' in '%s'", e->text);
+        return value;
+    }
+    if (*e->p == '-' || *e->p == '+') {
+        int negative = *e->p++ == '-';
+        int64_t value = parse_factor(e);
+        return negative ? -value : value;
+    }
+    if (is_symbol_start(*e->p)) {
+        const char* start = e->p;
+        while (is_symbol_char(*e->p)) e->p++;
+        char name[MAX_LINE];
+        memcpy(name, start, e->p - start);
+        name[e->p - start] = 0;
+        struct symbol* symbol = find_symbol(name);
+        if (e->uses_symbol && !(symbol && symbol->constant && symbol->line < line_number)) *e->uses_symbol = 1;
+        if (symbol && symbol->defined)
+            return symbol_value(symbol);
+        if (pass == 2)
+            error("undefined symbol '%s'", name);
+        return 0;
+    }
+    if (!isdigit((unsigned char)*e->p))
+        error("bad value '%s'", e->text);
+    errno = 0;
+    char* end;
+    long long number = strtoll(e->p, &end, 0);
+    if (errno || number > 0xffffffffLL)
+        error("bad value '%s'", e->text);
+    e->p = end;
+    return number;
+}
+
+static int64_t parse_product(struct expression* e)
+{
+    int64_t value = parse_factor(e);
+    for (;;) {
+        skip_spaces(e);
+        char op = *e->p;
+        if (op == '<' || op == '>') {
+            if (e->p[1] != op)
+                error("bad value '%s'", e->text);
+            e->p++;
+        } else if (op != '*' && op != '/' && op != '%') {
+            return value;
+        }
+        e->p++;
+        int64_t right = parse_factor(e);
+        if ((op == '/' || op == '%') && right == 0) {
+            // undefined symbols are 0 in the first pass
+            if (pass == 2)
+                error("division by zero in '%s'", e->text);
+            right = 1;
+        }
+        if (op == '*') value = (uint32_t)(value * right);
+        else if (op == '/') value = (int32_t)value / (int32_t)right;
+        else if (op == '%') value = (int32_t)value % (int32_t)right;
+        else if (op == '<') value = (uint32_t)value << (right & 31);
+        else value = (uint32_t)value >> (right & 31);
+    }
+}
+
+static int64_t parse_sum(struct expression* e)
+{
+    int64_t value = parse_product(e);
+    for (;;) {
+        skip_spaces(e);
+        if (*e->p != '+' && *e->p != '-')
+            return value;
+        int negative = *e->p++ == '-';
+        int64_t right = parse_product(e);
+        value = (uint32_t)(negative ? value - right : value + right);
+    }
+}
+
+// an expression, %hi(value) or %lo(value)
+static int32_t parse_value(const char* s, int* uses_symbol)
+{
+    char text[MAX_LINE];
+    snprintf(text, sizeof(text), "%s", s);
+    char* p = trim(text);
+    int hi = !strncmp(p, "%hi(", 4);
+    int lo = !strncmp(p, "%lo(", 4);
+    if (hi || lo) {
+        size_t len = strlen(p);
+        if (p[len - 1] != ')')
+            error("missing ')' in '%s'", s);
+        p[len - 1] = 0;
+        int32_t value = parse_value(p + 4, uses_symbol);
+        int32_t low = (int32_t)((uint32_t)value << 20) >> 20;
+        return hi ? (int32_t)((uint32_t)value - (uint32_t)low) : low;
+    }
+    struct expression e = { p, s, uses_symbol };
+    int64_t value = parse_sum(&e);
+    skip_spaces(&e);
+    if (*e.p || *p == 0)
+        error("bad value '%s'", s);
+    return (int32_t)(uint32_t)value;
+}
+
+// "imm(reg)" or "(reg)"
+static void parse_memory_operand(char* s, int32_t* imm, int* reg)
+{
+    char* open = strrchr(s, '(');
+    char* close = strrchr(s, ')');
+    if (!open || !close || close < open || trim(close + 1)[0])
+        error("expected imm(register), not '%s'", s);
+    *close = 0;
+    *reg = parse_register(trim(open + 1));
+    *open = 0;
+    *imm = *trim(s) ? parse_value(s, NULL) : 0;
+}
+
+// split at commas outside quotes; returns the number of operands
+static int split_operands(char* s, char* operands[])
+{
+    int count = 0;
+    s = trim(s);
+    if (*s == 0)
+        return 0;
+    int quoted = 0;
+    operands[count++] = s;
+    for (char* p = s; *p; p++) {
+        if (*p == '"' && (p == s || p[-1] != '\\'))
+            quoted = !quoted;
+        if (*p == ',' && !quoted) {
+            if (count == MAX_OPERANDS)
+                error("too many operands");
+            *p = 0;
+            operands[count++] = p + 1;
+        }
+    }
+    for (int i = 0; i < count; i++)
+        operands[i] = trim(operands[i]);
+    return count;
+}
+
+// ---- instructions
+
+static void check_range(int32_t value, int32_t low, int32_t high, const char* what)
+{
+    if (value < low || value > high)
+        error("%s %d out of range", what, value);
+}
+
+static uint32_t encode(const struct insn_info* info, int rd, int rs1, int rs2, int32_t imm)
+{
+    uint32_t word = info->match;
+    uint32_t u = (uint32_t)imm;
+    switch (info->format) {
+    case FMT_R:
+        return word | rd << 7 | rs1 << 15 | rs2 << 20;
+    case FMT_I:
+    case FMT_LOAD:
+        check_range(imm, -2048, 2047, "immediate");
+        return word | rd << 7 | rs1 << 15 | (u & 0xfff) << 20;
+    case FMT_SHIFT:
+        check_range(imm, 0, 31, "shift amount");
+        return word | rd << 7 | rs1 << 15 | u << 20;
+    case FMT_S:
+        check_range(imm, -2048, 2047, "offset");
+        return word | (u & 0x1f) << 7 | rs1 << 15 | rs2 << 20 | ((u >> 5) & 0x7f) << 25;
+    case FMT_B:
+        check_range(imm, -4096, 4094, "branch offset");
+        if (imm & 1) error("odd branch offset");
+        return word | ((u >> 11) & 1) << 7 | ((u >> 1) & 0xf) << 8 | rs1 << 15 | rs2 << 20
+             | ((u >> 5) & 0x3f) << 25 | ((u >> 12) & 1) << 31;
+    case FMT_U:
+        if (u & 0xfff) error("the low 12 bits of 0x%x are not zero (use %%hi)", u);
+        return word | rd << 7 | u;
+    case FMT_J:
+        check_range(imm, -(1 << 20), (1 << 20) - 2, "jump offset");
+        if (imm & 1) error("odd jump offset");
+        return word | rd << 7 | (u & 0xff000) | ((u >> 11) & 1) << 20 | ((u >> 1) & 0x3ff) << 21
+             | ((u >> 20) & 1) << 31;
+    default:
+        return word;
+    }
+}
+
+static const struct insn_info* find_insn(const char* mnemonic)
+{
+    for (int id = 1; id < NUM_INSNS; id++)
+        if (insn_info[id].base == id && !strcmp(insn_info[id].mnemonic, mnemonic))
+            return &insn_info[id];
+    return NULL;
+}
+
+static void emit_insn(uint32_t word)
+{
+    if (section != TEXT)
+        error("instructions belong in .text");
+    if (pass == 1) advance(4);
+    else put_word(&sections[TEXT], word);
+}
+
+static void emit(const char* mnemonic, int rd, int rs1, int rs2, int32_t imm)
+{
+    emit_insn(pass == 1 ? 0 : encode(find_insn(mnemonic), rd, rs1, rs2, imm));
+}
+
+static void expect_operands(int count, int expected, const char* mnemonic)
+{
+    if (count != expected)
+        error("%s takes %d operands", mnemonic, expected);
+}
+
+// li and la: lui + addi, or a single addi or lui when a number fits in one
+static void load_value(int rd, const char* operand, int always_two)
+{
+    int uses_symbol = 0;
+    int32_t value = parse_value(operand, &uses_symbol);
+    int32_t low = (int32_t)((uint32_t)value << 20) >> 20;
+    int one = !always_two && !uses_symbol;
+    if (one && value >= -2048 && value < 2048) {
+        emit("addi", rd, 0, 0, value);
+        return;
+    }
+    emit("lui", rd, 0, 0, (int32_t)((uint32_t)value - (uint32_t)low));
+    if (!one || low)
+        emit("addi", rd, rd, 0, low);
+}
+
+// branches against zero and with the operands swapped
+static const struct {
+    const char* name;
+    const char* branch;
+    int zero;             // 0: two registers, 1: rs and x0, 2: x0 and rs
+    int swap;
+} branch_pseudos[] = {
+    { "beqz", "beq", 1, 0 }, { "bnez", "bne", 1, 0 }, { "bltz", "blt", 1, 0 }, { "bgez", "bge", 1, 0 },
+    { "bgtz", "blt", 2, 0 }, { "blez", "bge", 2, 0 }, { "bgt", "blt", 0, 1 }, { "ble", "bge", 0, 1 },
+    { "bgtu", "bltu", 0, 1 }, { "bleu", "bgeu", 0, 1 },
+};
+
+static int branch_pseudo(const char* mnemonic, char* operands[], int count)
+{
+    for (size_t i = 0; i < sizeof(branch_pseudos) / sizeof(branch_pseudos[0]); i++) {
+        if (strcmp(mnemonic, branch_pseudos[i].name))
+            continue;
+        expect_operands(count, branch_pseudos[i].zero ? 2 : 3, mnemonic);
+        int rs = parse_register(operands[0]);
+        int rt = branch_pseudos[i].zero ? 0 : parse_register(operands[1]);
+        if (branch_pseudos[i].zero == 2 || branch_pseudos[i].swap) {
+            int t = rs;
+            rs = rt;
+            rt = t;
+        }
+        uint32_t pc = here();
+        emit(branch_pseudos[i].branch, 0, rs, rt, (int32_t)(parse_value(operands[count - 1], NULL) - pc));
+        return 1;
+    }
+    return 0;
+}
+
+static int pseudo(const char* mnemonic, char* operands[], int count)
+{
+    if (!strcmp(mnemonic, "nop")) {
+        expect_operands(count, 0, mnemonic);
+        emit("addi", 0, 0, 0, 0);
+    } else if (!strcmp(mnemonic, "mv")) {
+        expect_operands(count, 2, mnemonic);
+        emit("addi", parse_register(operands[0]), parse_register(operands[1]), 0, 0);
+    } else if (!strcmp(mnemonic, "li") || !strcmp(mnemonic, "la")) {
+        expect_operands(count, 2, mnemonic);
+        load_value(parse_register(operands[0]), operands[1], mnemonic[1] == 'a');
+    } else if (!strcmp(mnemonic, "j") || !strcmp(mnemonic, "call")) {
+        expect_operands(count, 1, mnemonic);
+        uint32_t pc = here();
+        emit("jal", mnemonic[0] == 'j' ? 0 : 1, 0, 0, (int32_t)(parse_value(operands[0], NULL) - pc));
+    } else if (!strcmp(mnemonic, "ret")) {
+        expect_operands(count, 0, mnemonic);
+        emit("jalr", 0, 1, 0, 0);
+    } else {
+        return branch_pseudo(mnemonic, operands, count);
+    }
+    return 1;
+}
+
+static void instruction(const char* mnemonic, char* operands[], int count)
+{
+    if (pseudo(mnemonic, operands, count))
+        return;
+    const struct insn_info* info = find_insn(mnemonic);
+    if (!info)
+        error("unknown instruction '%s'", mnemonic);
+    if (pass == 1) {
+        emit_insn(0);
+        return;
+    }
+    uint32_t pc = here();
+    int rd = 0, rs1 = 0, rs2 = 0;
+    int32_t imm = 0;
+    switch (info->format) {
+    case FMT_R:
+        expect_operands(count, 3, mnemonic);
+        rd = parse_register(operands[0]);
+        rs1 = parse_register(operands[1]);
+        rs2 = parse_register(operands[2]);
+        break;
+    case FMT_I:
+    case FMT_SHIFT:
+        expect_operands(count, 3, mnemonic);
+        rd = parse_register(operands[0]);
+        rs1 = parse_register(operands[1]);
+        imm = parse_value(operands[2], NULL);
+        break;
+    case FMT_LOAD:
+        expect_operands(count, 2, mnemonic);
+        rd = parse_register(operands[0]);
+        parse_memory_operand(operands[1], &imm, &rs1);
+        break;
+    case FMT_S:
+        expect_operands(count, 2, mnemonic);
+        rs2 = parse_register(operands[0]);
+        parse_memory_operand(operands[1], &imm, &rs1);
+        break;
+    case FMT_B:
+        expect_operands(count, 3, mnemonic);
+        rs1 = parse_register(operands[0]);
+        rs2 = parse_register(operands[1]);
+        imm = (int32_t)(parse_value(operands[2], NULL) - pc);
+        break;
+    case FMT_U:
+        expect_operands(count, 2, mnemonic);
+        rd = parse_register(operands[0]);
+        imm = parse_value(operands[1], NULL);
+        break;
+    case FMT_J:
+        expect_operands(count, 2, mnemonic);
+        rd = parse_register(operands[0]);
+        imm = (int32_t)(parse_value(operands[1], NULL) - pc);
+        break;
+    case FMT_SYS:
+        expect_operands(count, 0, mnemonic);
+        break;
+    }
+    emit_insn(encode(info, rd, rs1, rs2, imm));
+}
+
+// ---- directives
+
+static void emit_data(const void* data, size_t len)
+{
+    if (section == BSS) {
+        for (size_t i = 0; i < len; i++)
+            if (((const unsigned char*)data)[i])
+                error(".bss holds zeroes only");
+        if (pass == 1) advance(len);
+        else sections[BSS].len += len;
+        return;
+    }
+    if (pass == 1) advance(len);
+    else put_bytes(&sections[section], data, len);
+}
+
+static void emit_string(const char* s, int terminate)
+{
+    if (*s != '"' || s[strlen(s) - 1] != '"' || strlen(s) < 2)
+        error("expected a string in quotes");
+    for (const char* p = s + 1; p < s + strlen(s) - 1; p++) {
+        char c = *p;
+        if (c == '\\') {
+            switch (*++p) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case '0': c = 0; break;
+            default: c = *p; break;
+            }
+        }
+        emit_data(&c, 1);
+    }
+    if (terminate)
+        emit_data("", 1);
+}
+
+static void directive(const char* name, char* operands[], int count)
+{
+    if (!strcmp(name, ".text")) {
+        section = TEXT;
+    } else if (!strcmp(name, ".data")) {
+        section = DATA;
+    } else if (!strcmp(name, ".bss")) {
+        section = BSS;
+    } else if (!strcmp(name, ".globl") || !strcmp(name, ".global")) {
+        for (int i = 0; i < count; i++)
+            add_symbol(operands[i])->global = 1;
+    } else if (!strcmp(name, ".equ") || !strcmp(name, ".set")) {
+        expect_operands(count, 2, name);
+        if (!is_symbol_start(operands[0][0]))
+            error("'%s' is not a symbol name", operands[0]);
+        int uses_symbol = 0;
+        int32_t value = parse_value(operands[1], &uses_symbol);
+        if (uses_symbol)
+            error("the value of '%s' must be a number or an earlier constant", operands[0]);
+        struct symbol* symbol = add_symbol(operands[0]);
+        if (pass == 1) {
+            if (symbol->defined)
+                error("'%s' is defined twice", operands[0]);
+            symbol->defined = 1;
+            symbol->constant = 1;
+            symbol->line = line_number;
+            symbol->offset = value;
+        }
+    } else if (!strcmp(name, ".word") || !strcmp(name, ".half") || !strcmp(name, ".byte")) {
+        int size = name[1] == 'w' ? 4 : name[1] == 'h' ? 2 : 1;
+        for (int i = 0; i < count; i++) {
+            uint32_t value = parse_value(operands[i], NULL);
+            unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+            emit_data(bytes, size);
+        }
+    } else if (!strcmp(name, ".zero") || !strcmp(name, ".space")) {
+        expect_operands(count, 1, name);
+        int32_t n = parse_value(operands[0], NULL);
+        check_range(n, 0, 1 << 28, "size");
+        for (int32_t i = 0; i < n; i++)
+            emit_data("", 1);
+    } else if (!strcmp(name, ".ascii") || !strcmp(name, ".asciz") || !strcmp(name, ".string")) {
+        expect_operands(count, 1, name);
+        emit_string(operands[0], name[3] != 'c');
+    } else if (!strcmp(name, ".align") || !strcmp(name, ".p2align")) {
+        expect_operands(count, 1, name);
+        int32_t n = parse_value(operands[0], NULL);
+        check_range(n, 0, 12, "alignment");
+        while (here() & ((1u << n) - 1)) {
+            if (section == TEXT && !(here() & 3)) emit("addi", 0, 0, 0, 0);
+            else emit_data("", 1);
+        }
+    } else {
+        error("unknown directive '%s'", name);
+    }
+}
+
+// ---- the source
+
+static void assemble_line(char* line)
+{
+    // comments, outside strings
+    int quoted = 0;
+    for (char* p = line; *p; p++) {
+        if (*p == '"' && (p == line || p[-1] != '\\')) quoted = !quoted;
+        if (*p == '#' && !quoted) {
+            *p = 0;
+            break;
+        }
+    }
+    char* p = trim(line);
+    // labels
+    for (;;) {
+        char* q = p;
+        while (is_symbol_char(*q)) q++;
+        if (q == p || *q != ':' || !is_symbol_start(*p))
+            break;
+        *q = 0;
+        struct symbol* symbol = add_symbol(p);
+        if (pass == 1) {
+            if (symbol->defined)
+                error("'%s' is defined twice", p);
+            symbol->defined = 1;
+            symbol->section = section;
+            symbol->offset = section_size[section];
+        }
+        p = trim(q + 1);
+    }
+    if (*p == 0)
+        return;
+    char* mnemonic = p;
+    while (*p && !isspace((unsigned char)*p)) p++;
+    if (*p) *p++ = 0;
+    char* operands[MAX_OPERANDS];
+    int count = split_operands(p, operands);
+    if (mnemonic[0] == '.') directive(mnemonic, operands, count);
+    else instruction(mnemonic, operands, count);
+}
+
+static void assemble(FILE* file)
+{
+    char line[MAX_LINE];
+    rewind(file);
+    line_number = 0;
+    section = TEXT;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = 0;
+        assemble_line(line);
+    }
+}
+
+// ---- the ELF file
+//
+// The text segment starts with the ELF header and the program headers, as
+// read_elf() expects; the data segment (possibly empty) follows on its own
+// page. Then the symbol table, its strings and the section headers. With
+// always two program headers the text starts at the same address whether
+// there is data or not, so the first pass knows all text addresses.
+
+#define NUM_PHDRS 2
+#define HEADERS_SIZE (sizeof(Elf32_Ehdr) + NUM_PHDRS * sizeof(Elf32_Phdr))
+
+enum { SH_NULL, SH_TEXT, SH_DATA, SH_BSS, SH_SYMTAB, SH_STRTAB, SH_SHSTRTAB, NUM_SECTIONS };
+
+static const char shstrtab[] = "\0.text\0.data\0.bss\0.symtab\0.strtab\0.shstrtab";
+
+static uint32_t align_up(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void write_elf(FILE* out, uint32_t text_segment)
+{
+    struct buffer file = { 0 };
+    uint32_t text_offset = HEADERS_SIZE;
+    uint32_t data_offset = align_up(text_offset + sections[TEXT].len, SEGMENT_ALIGN);
+
+    // symbols, locals first as ELF wants
+    struct buffer symtab = { 0 }, strtab = { 0 };
+    Elf32_Sym sym = { 0 };
+    put_bytes(&symtab, &sym, sizeof(sym));
+    put_bytes(&strtab, "", 1);
+    int first_global = 1;
+    for (int global = 0; global <= 1; global++) {
+        for (int i = 0; i < num_symbols; i++) {
+            struct symbol* symbol = &symbols[i];
+            if (symbol->global != global || !symbol->defined || symbol->constant)
+                continue;
+            memset(&sym, 0, sizeof(sym));
+            sym.st_name = strtab.len;
+            sym.st_value = symbol_value(symbol);
+            sym.st_info = ELF32_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, symbol->section == TEXT ? STT_FUNC : STT_OBJECT);
+            sym.st_shndx = symbol->section == TEXT ? SH_TEXT : symbol->section == DATA ? SH_DATA : SH_BSS;
+            put_bytes(&symtab, &sym, sizeof(sym));
+            put_bytes(&strtab, symbol->name, strlen(symbol->name) + 1);
+            if (!global) first_global++;
+        }
+    }
+    uint32_t symtab_offset = align_up(data_offset + sections[DATA].len, 4);
+    uint32_t strtab_offset = symtab_offset + symtab.len;
+    uint32_t shstrtab_offset = strtab_offset + strtab.len;
+    uint32_t shdr_offset = align_up(shstrtab_offset + sizeof(shstrtab), 4);
+
+    struct symbol* start = find_symbol("_start");
+    Elf32_Ehdr ehdr = { 0 };
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_RISCV;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_entry = start && start->defined ? symbol_value(start) : section_base[TEXT];
+    ehdr.e_phoff = sizeof(Elf32_Ehdr);
+    ehdr.e_shoff = shdr_offset;
+    ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf32_Phdr);
+    ehdr.e_phnum = NUM_PHDRS;
+    ehdr.e_shentsize = sizeof(Elf32_Shdr);
+    ehdr.e_shnum = NUM_SECTIONS;
+    ehdr.e_shstrndx = SH_SHSTRTAB;
+    put_bytes(&file, &ehdr, sizeof(ehdr));
+
+    Elf32_Phdr phdr = { 0 };
+    phdr.p_type = PT_LOAD;
+    phdr.p_offset = 0;
+    phdr.p_vaddr = phdr.p_paddr = text_segment;
+    phdr.p_filesz = phdr.p_memsz = text_offset + sections[TEXT].len;
+    phdr.p_flags = PF_R | PF_X;
+    phdr.p_align = SEGMENT_ALIGN;
+    put_bytes(&file, &phdr, sizeof(phdr));
+    phdr.p_offset = data_offset;
+    phdr.p_vaddr = phdr.p_paddr = section_base[DATA];
+    phdr.p_filesz = phdr.p_memsz = sections[DATA].len;
+    if (sections[BSS].len)
+        phdr.p_memsz = section_base[BSS] + sections[BSS].len - section_base[DATA];
+    phdr.p_flags = PF_R | PF_W;
+    put_bytes(&file, &phdr, sizeof(phdr));
+    put_bytes(&file, sections[TEXT].data, sections[TEXT].len);
+    while (file.len < data_offset) put_bytes(&file, "", 1);
+    put_bytes(&file, sections[DATA].data, sections[DATA].len);
+    while (file.len < symtab_offset) put_bytes(&file, "", 1);
+    put_bytes(&file, symtab.data, symtab.len);
+    put_bytes(&file, strtab.data, strtab.len);
+    put_bytes(&file, shstrtab, sizeof(shstrtab));
+    while (file.len < shdr_offset) put_bytes(&file, "", 1);
+
+    Elf32_Shdr shdr[NUM_SECTIONS];
+    memset(shdr, 0, sizeof(shdr));
+    shdr[SH_TEXT] = (Elf32_Shdr){ 1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, section_base[TEXT], text_offset,
+                                  sections[TEXT].len, 0, 0, 4, 0 };
+    shdr[SH_DATA] = (Elf32_Shdr){ 7, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, section_base[DATA], data_offset,
+                                  sections[DATA].len, 0, 0, 4, 0 };
+    shdr[SH_BSS] = (Elf32_Shdr){ 13, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, section_base[BSS], data_offset + sections[DATA].len,
+                                 sections[BSS].len, 0, 0, 4, 0 };
+    shdr[SH_SYMTAB] = (Elf32_Shdr){ 18, SHT_SYMTAB, 0, 0, symtab_offset, symtab.len, SH_STRTAB, first_global,
+                                    4, sizeof(Elf32_Sym) };
+    shdr[SH_STRTAB] = (Elf32_Shdr){ 26, SHT_STRTAB, 0, 0, strtab_offset, strtab.len, 0, 0, 1, 0 };
+    shdr[SH_SHSTRTAB] = (Elf32_Shdr){ 34, SHT_STRTAB, 0, 0, shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0 };
+    put_bytes(&file, shdr, sizeof(shdr));
+
+    if (fwrite(file.data, 1, file.len, out) != file.len) {
+        perror("rvasm: write");
+        exit(1);
+    }
+    free(file.data);
+    free(symtab.data);
+    free(strtab.data);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: rvasm prog.s [-o prog.riscv] [-t text address]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* out_name = NULL;
+    uint32_t text_addr = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_name = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            text_addr = strtoul(argv[++i], NULL, 0);
+        else if (argv[i][0] == '-' || file_name)
+            usage();
+        else
+            file_name = argv[i];
+    }
+    if (!file_name)
+        usage();
+    FILE* in = fopen(file_name, "r");
+    if (!in) {
+        perror(file_name);
+        return 1;
+    }
+
+    if (text_addr && text_addr < HEADERS_SIZE) {
+        fprintf(stderr, "rvasm: text address 0x%x too low\n", text_addr);
+        return 1;
+    }
+    uint32_t text_segment = text_addr ? text_addr - HEADERS_SIZE : DEFAULT_TEXT;
+    section_base[TEXT] = text_segment + HEADERS_SIZE;
+
+    // first pass: the symbols and section sizes. Data addresses are relative
+    // to the page the data will start on
+    pass = 1;
+    assemble(in);
+    section_base[DATA] = align_up(section_base[TEXT] + section_size[TEXT], SEGMENT_ALIGN);
+    // on a page of its own too, so alignments from the first pass hold
+    section_base[BSS] = align_up(section_base[DATA] + section_size[DATA], SEGMENT_ALIGN);
+
+    // second pass: the code
+    pass = 2;
+    assemble(in);
+    fclose(in);
+    if (sections[TEXT].len != section_size[TEXT] || sections[DATA].len != section_size[DATA]
+        || sections[BSS].len != section_size[BSS]) {
+        fprintf(stderr, "%s: the two passes disagree about the section sizes\n", file_name);
+        return 1;
+    }
+
+    char default_name[MAX_LINE];
+    if (!out_name) {
+        snprintf(default_name, sizeof(default_name), "%s", file_name);
+        char* dot = strrchr(default_name, '.');
+        if (dot && !strchr(dot, '/')) *dot = 0;
+        strncat(default_name, ".riscv", sizeof(default_name) - strlen(default_name) - 1);
+        out_name = default_name;
+    }
+    FILE* out = fopen(out_name, "wb");
+    if (!out) {
+        perror(out_name);
+        return 1;
+    }
+    write_elf(out, text_segment);
+    if (fclose(out)) {
+        perror(out_name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// rvgen: generate synthetic RV32IM workloads for stress and scaling tests
+//
+//   rvgen [options] > workload.s
+//   tools/rvasm workload.s          (gives workload.riscv)
+//
+//   -n blocks       number of basic blocks, i.e. code size (default 64)
+//   -b insns        instructions per block besides the branch (default 8)
+//   -m mix          relative weights of the instruction classes in a block,
+//                   e.g. alu=60,mul=10,div=5,load=15,store=10 (the default)
+//   -p percent      how many of the blocks end in a predictable branch (default 100)
+//   -f bytes        data footprint, a power of two (default 65536)
+//   -s bytes        stride between data accesses, a multiple of 4 (default 64)
+//   -i iterations   times through all the blocks (default: about 10 million instructions)
+//   -r seed         for the generator's random choices (default 1)
+//
+// The blocks run one after the other, -i times. Each ends in a branch that
+// skips one instruction when taken: predictable branches are always taken,
+// the others depend on a bit from a random number generator in the guest,
+// so the host cannot predict them. Both kinds cost 4 instructions (5 when
+// not taken). A load or store is 4 instructions: the address is the
+// data base plus a running offset, masked to the footprint, and the offset
+// then moves on by the stride. The data lives at DATA_BASE, outside the ELF
+// file, and costs host memory only where it is written.
+//
+// The program exits with a checksum of its registers, so two runs (or two
+// engine modes) can be compared.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_BASE 0x40000000
+#define TARGET_INSNS 10000000L
+
+enum insn_class { ALU, MUL, DIV, LOAD, STORE, NUM_CLASSES };
+
+static const char* class_names[NUM_CLASSES] = { "alu", "mul", "div", "load", "store" };
+
+// registers the generated code computes with: a0..a5
+static const char* work_regs[] = { "a0", "a1", "a2", "a3", "a4", "a5" };
+#define NUM_WORK_REGS 6
+
+static const char* alu_ops[] = { "add", "sub", "xor", "or", "and", "sll", "srl", "sra", "slt", "sltu" };
+static const char* alu_imm_ops[] = { "addi", "xori", "ori", "andi", "slti" };
+static const char* shift_imm_ops[] = { "slli", "srli", "srai" };
+static const char* mul_ops[] = { "mul", "mulh", "mulhsu", "mulhu" };
+static const char* div_ops[] = { "div", "divu", "rem", "remu" };
+static const char* load_ops[] = { "lw", "lh", "lhu", "lb", "lbu" };
+static const char* store_ops[] = { "sw", "sh", "sb" };
+
+#define COUNT(a) (int)(sizeof(a) / sizeof(a[0]))
+
+static uint64_t random_state;
+static FILE* out;      // where the generated code goes
+
+static uint32_t next_random(void)
+{
+    // xorshift64*
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return (uint32_t)((random_state * 2685821657736338717ull) >> 32);
+}
+
+static int pick(int n)
+{
+    return next_random() % n;
+}
+
+static const char* reg(void)
+{
+    return work_regs[pick(NUM_WORK_REGS)];
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: rvgen [-n blocks] [-b insns] [-m alu=w,mul=w,div=w,load=w,store=w] [-p percent]\n"
+                    "             [-f footprint] [-s stride] [-i iterations] [-r seed] > workload.s\n");
+    exit(1);
+}
+
+static void parse_mix(char* mix, int weights[])
+{
+    memset(weights, 0, NUM_CLASSES * sizeof(int));
+    for (char* item = strtok(mix, ","); item; item = strtok(NULL, ",")) {
+        char* equals = strchr(item, '=');
+        if (!equals) usage();
+        *equals = 0;
+        int i = 0;
+        while (i < NUM_CLASSES && strcmp(item, class_names[i])) i++;
+        if (i == NUM_CLASSES) usage();
+        weights[i] = atoi(equals + 1);
+    }
+}
+
+static int pick_class(const int weights[], int total)
+{
+    int r = pick(total);
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        if (r < weights[i]) return i;
+        r -= weights[i];
+    }
+    return ALU;
+}
+
+// one instruction of the class; returns the number of guest instructions emitted
+static int emit(int cls)
+{
+    switch (cls) {
+    case MUL:
+        fprintf(out, "        %s %s, %s, %s\n", mul_ops[pick(COUNT(mul_ops))], reg(), reg(), reg());
+        return 1;
+    case DIV:
+        fprintf(out, "        %s %s, %s, %s\n", div_ops[pick(COUNT(div_ops))], reg(), reg(), reg());
+        return 1;
+    case LOAD:
+    case STORE: {
+        // s1 running offset, s2 footprint mask (word aligned), s3 stride, s0 data base
+        fprintf(out, "        and t0, s1, s2\n");
+        fprintf(out, "        add t0, t0, s0\n");
+        if (cls == LOAD)
+            fprintf(out, "        %s %s, 0(t0)\n", load_ops[pick(COUNT(load_ops))], reg());
+        else
+            fprintf(out, "        %s %s, 0(t0)\n", store_ops[pick(COUNT(store_ops))], reg());
+        fprintf(out, "        add s1, s1, s3\n");
+        return 4;
+    }
+    default:
+        switch (pick(3)) {
+        case 0:
+            fprintf(out, "        %s %s, %s, %s\n", alu_ops[pick(COUNT(alu_ops))], reg(), reg(), reg());
+            break;
+        case 1:
+            fprintf(out, "        %s %s, %s, %d\n", alu_imm_ops[pick(COUNT(alu_imm_ops))], reg(), reg(), pick(4096) - 2048);
+            break;
+        default:
+            fprintf(out, "        %s %s, %s, %d\n", shift_imm_ops[pick(COUNT(shift_imm_ops))], reg(), reg(), pick(32));
+            break;
+        }
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long blocks = 64, block_insns = 8, predictable = 100, footprint = 65536, stride = 64, iterations = 0, seed = 1;
+    char default_mix[] = "alu=60,mul=10,div=5,load=15,store=10";
+    int weights[NUM_CLASSES];
+    parse_mix(default_mix, weights);
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][2] || i + 1 == argc) usage();
+        char* value = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'n': blocks = strtol(value, NULL, 0); break;
+        case 'b': block_insns = strtol(value, NULL, 0); break;
+        case 'm': parse_mix(value, weights); break;
+        case 'p': predictable = strtol(value, NULL, 0); break;
+        case 'f': footprint = strtol(value, NULL, 0); break;
+        case 's': stride = strtol(value, NULL, 0); break;
+        case 'i': iterations = strtol(value, NULL, 0); break;
+        case 'r': seed = strtol(value, NULL, 0); break;
+        default: usage();
+        }
+    }
+    int total = 0;
+    for (int i = 0; i < NUM_CLASSES; i++) total += weights[i];
+    if (blocks < 1 || block_insns < 0 || total <= 0 || predictable < 0 || predictable > 100
+        || footprint < 4 || footprint > 0x40000000 || (footprint & (footprint - 1)) || stride % 4) {
+        fprintf(stderr, "rvgen: bad parameters\n");
+        usage();
+    }
+    random_state = (uint64_t)seed * 0x9e3779b97f4a7c15ull + 1;
+
+    // the blocks first, to know how many instructions one iteration takes
+    char* blocks_text;
+    size_t blocks_len;
+    out = open_memstream(&blocks_text, &blocks_len);
+    if (!out) {
+        perror("rvgen");
+        return 1;
+    }
+    long iteration_insns = 5;   // the loop at the end
+    for (long b = 0; b < blocks; b++) {
+        fprintf(out, "block_%ld:\n", b);
+        for (long i = 0; i < block_insns; i++)
+            iteration_insns += emit(pick_class(weights, total));
+        // the next number from the guest's generator either way
+        fprintf(out, "        mul s5, s5, s6\n");
+        fprintf(out, "        add s5, s5, s7\n");
+        fprintf(out, "        srli t1, s5, 31\n");
+        if (pick(100) < predictable)
+            fprintf(out, "        beq t1, t1, skip_%ld\n", b);
+        else
+            fprintf(out, "        bne t1, zero, skip_%ld\n", b);
+        fprintf(out, "        addi a0, a0, 1\n");
+        fprintf(out, "skip_%ld:\n", b);
+        iteration_insns += 4;
+    }
+    fclose(out);
+    if (iterations <= 0)
+        iterations = TARGET_INSNS / iteration_insns > 0 ? TARGET_INSNS / iteration_insns : 1;
+
+    out = stdout;
+    fprintf(out, "# generated by: rvgen");
+    for (int i = 1; i < argc; i++) fprintf(out, " %s", argv[i]);
+    fprintf(out, "\n# %ld instructions per iteration\n", iteration_insns);
+    fprintf(out, "        .globl _start\n_start:\n");
+    fprintf(out, "        li sp, 0x1000000\n");
+    fprintf(out, "        li s0, 0x%x\n", DATA_BASE);
+    fprintf(out, "        li s1, 0\n");
+    fprintf(out, "        li s2, %ld\n", (footprint - 1) & ~3L);
+    fprintf(out, "        li s3, %ld\n", stride);
+    fprintf(out, "        li s4, %ld\n", iterations);
+    fprintf(out, "        li s5, %ld\n", seed);
+    fprintf(out, "        li s6, 1664525\n");
+    fprintf(out, "        li s7, 1013904223\n");
+    for (int r = 0; r < NUM_WORK_REGS; r++)
+        fprintf(out, "        li %s, %u\n", work_regs[r], next_random() & 0x7ff);
+    fprintf(out, "        .globl iteration\niteration:\n");
+    fwrite(blocks_text, 1, blocks_len, out);
+    free(blocks_text);
+    // the blocks may be further away than a branch reaches
+    fprintf(out, "        addi s4, s4, -1\n");
+    fprintf(out, "        beq s4, zero, done\n");
+    fprintf(out, "        la t0, iteration\n");
+    fprintf(out, "        jalr zero, 0(t0)\n");
+    fprintf(out, "done:\n");
+    for (int r = 1; r < NUM_WORK_REGS; r++)
+        fprintf(out, "        xor a0, a0, %s\n", work_regs[r]);
+    fprintf(out, "        andi a0, a0, 0xff\n");
+    fprintf(out, "        li a7, 93\n");
+    fprintf(out, "        ecall\n");
+    return 0;
+}